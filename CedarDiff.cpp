@@ -0,0 +1,229 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "CedarDiff.h"
+#include "CedarLexer.h"
+#include <limits.h>
+using namespace Cedar;
+
+void Diff::tokenize(const QString& code, const QVector<TiogaSpan>& spans, Tokens& out)
+{
+    out.ids.clear();
+    out.lines.clear();
+    Lexer lex;
+    lex.setStream(code);
+    lex.setComments(spans);
+    lex.setIgnoreComments(false);
+    lex.setCopyValues(false);
+    QByteArray key;
+    Token t = lex.nextToken();
+    while( t.d_type != Tok_Eof )
+    {
+        const QByteArray val = lex.text(t);
+        key.resize(0);
+        key.append(char(t.d_type));
+        if( t.d_type == Tok_Comment )
+        {
+            // "--" of the code and the "-- " of Tioga comment nodes are not content
+            QByteArray c = val;
+            if( c.startsWith("--") )
+                c = c.mid(2);
+            if( c.endsWith("--") )
+                c.chop(2);
+            key.append(c.simplified());
+        }else
+            key.append(val);
+        quint32& id = d_ids[key];
+        if( id == 0 )
+            id = d_ids.size();
+        out.ids.append(id);
+        out.lines.append(t.d_lineNr);
+        t = lex.nextToken();
+    }
+}
+
+struct cdiff_Context
+{
+    const quint32* a;
+    const quint32* b;
+    int* fd; // furthest x of the forward search per diagonal x - y
+    int* bd; // and of the backward search
+    bool* ca; // the changed elements of a
+    bool* cb;
+
+    void middleSnake(int xoff, int xlim, int yoff, int ylim, int& xmid, int& ymid)
+    {
+        // the search runs from both corners until the paths meet; this is the "diag" of
+        // GNU diff without its heuristics
+        const int dmin = xoff - ylim, dmax = xlim - yoff;
+        const int fmid = xoff - yoff, bmid = xlim - ylim;
+        int fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid;
+        const bool odd = ( fmid - bmid ) & 1;
+        fd[fmid] = xoff;
+        bd[bmid] = xlim;
+        forever
+        {
+            if( fmin > dmin )
+                fd[--fmin - 1] = -1;
+            else
+                ++fmin;
+            if( fmax < dmax )
+                fd[++fmax + 1] = -1;
+            else
+                --fmax;
+            for( int d = fmax; d >= fmin; d -= 2 )
+            {
+                const int tlo = fd[d - 1], thi = fd[d + 1];
+                int x = tlo < thi ? thi : tlo + 1;
+                int y = x - d;
+                while( x < xlim && y < ylim && a[x] == b[y] )
+                {
+                    x++;
+                    y++;
+                }
+                fd[d] = x;
+                if( odd && bmin <= d && d <= bmax && bd[d] <= x )
+                {
+                    xmid = x;
+                    ymid = y;
+                    return;
+                }
+            }
+            if( bmin > dmin )
+                bd[--bmin - 1] = INT_MAX;
+            else
+                ++bmin;
+            if( bmax < dmax )
+                bd[++bmax + 1] = INT_MAX;
+            else
+                --bmax;
+            for( int d = bmax; d >= bmin; d -= 2 )
+            {
+                const int tlo = bd[d - 1], thi = bd[d + 1];
+                int x = tlo < thi ? tlo : thi - 1;
+                int y = x - d;
+                while( x > xoff && y > yoff && a[x - 1] == b[y - 1] )
+                {
+                    x--;
+                    y--;
+                }
+                bd[d] = x;
+                if( !odd && fmin <= d && d <= fmax && x <= fd[d] )
+                {
+                    xmid = x;
+                    ymid = y;
+                    return;
+                }
+            }
+        }
+    }
+
+    void compare(int xoff, int xlim, int yoff, int ylim)
+    {
+        while( xoff < xlim && yoff < ylim && a[xoff] == b[yoff] )
+        {
+            xoff++;
+            yoff++;
+        }
+        while( xlim > xoff && ylim > yoff && a[xlim - 1] == b[ylim - 1] )
+        {
+            xlim--;
+            ylim--;
+        }
+        if( xoff == xlim )
+        {
+            for( int y = yoff; y < ylim; y++ )
+                cb[y] = true;
+        }else if( yoff == ylim )
+        {
+            for( int x = xoff; x < xlim; x++ )
+                ca[x] = true;
+        }else
+        {
+            int xmid, ymid;
+            middleSnake(xoff, xlim, yoff, ylim, xmid, ymid);
+            compare(xoff, xmid, yoff, ymid);
+            compare(xmid, xlim, ymid, ylim);
+        }
+    }
+};
+
+QList<Diff::Hunk> Diff::compare(const QVector<quint32>& a, const QVector<quint32>& b)
+{
+    const int n = a.size(), m = b.size();
+    // the diagonals of both searches range from -m - 1 to n + 1
+    QVector<int> fd(n + m + 3), bd(n + m + 3);
+    QVector<bool> ca(n + 1), cb(m + 1);
+    cdiff_Context ctx;
+    ctx.a = a.constData();
+    ctx.b = b.constData();
+    ctx.fd = fd.data() + m + 1;
+    ctx.bd = bd.data() + m + 1;
+    ctx.ca = ca.data();
+    ctx.cb = cb.data();
+    ctx.compare(0, n, 0, m);
+
+    QList<Hunk> res;
+    int i = 0, j = 0;
+    while( i < n || j < m )
+    {
+        if( i < n && j < m && !ca[i] && !cb[j] )
+        {
+            i++;
+            j++;
+            continue;
+        }
+        Hunk h;
+        h.aFrom = i;
+        h.bFrom = j;
+        while( i < n && ca[i] )
+            i++;
+        while( j < m && cb[j] )
+            j++;
+        h.aLen = i - h.aFrom;
+        h.bLen = j - h.bFrom;
+        if( h.aLen == 0 && h.bLen == 0 )
+            break; // not reached
+        h.aLine = h.aLines = h.bLine = h.bLines = 0;
+        res.append(h);
+    }
+    return res;
+}
+
+static void cdiff_lines(const QVector<quint32>& lines, int from, int len, int& line, int& count)
+{
+    if( len == 0 )
+    {
+        line = from > 0 ? lines[from - 1] : 0;
+        count = 0;
+    }else
+    {
+        line = lines[from];
+        count = lines[from + len - 1] - line + 1;
+    }
+}
+
+QList<Diff::Hunk> Diff::compare(const Diff::Tokens& a, const Diff::Tokens& b)
+{
+    QList<Hunk> res = compare(a.ids, b.ids);
+    for( int i = 0; i < res.size(); i++ )
+    {
+        Hunk& h = res[i];
+        cdiff_lines(a.lines, h.aFrom, h.aLen, h.aLine, h.aLines);
+        cdiff_lines(b.lines, h.bFrom, h.bLen, h.bLine, h.bLines);
+    }
+    return res;
+}
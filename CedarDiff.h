@@ -0,0 +1,56 @@
+#ifndef CEDARDIFF_H
+#define CEDARDIFF_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QVector>
+
+struct TiogaSpan;
+
+namespace Cedar
+{
+    // Compares two versions of a module token by token, so changes of the whitespace, the
+    // indentation or the Tioga layout don't show. Each distinct token (type and text, comments
+    // with normalized whitespace) gets a number, and the two number sequences are compared with
+    // the linear space variant of the Myers algorithm.
+    class Diff
+    {
+    public:
+        struct Hunk
+        {
+            int aFrom, aLen, bFrom, bLen; // token indices
+            int aLine, aLines, bLine, bLines; // 1 based; with no lines, the line before the change
+        };
+        struct Tokens
+        {
+            QVector<quint32> ids;
+            QVector<quint32> lines;
+        };
+
+        // the spans are those of TiogaReader, for the comment lines
+        void tokenize(const QString& code, const QVector<TiogaSpan>& spans, Tokens&);
+        static QList<Hunk> compare(const Tokens& a, const Tokens& b);
+        static QList<Hunk> compare(const QVector<quint32>& a, const QVector<quint32>& b);
+    private:
+        QHash<QByteArray,quint32> d_ids; // shared by both versions
+    };
+}
+
+#endif // CEDARDIFF_H
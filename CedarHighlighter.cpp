@@ -21,7 +21,7 @@
 
 #include "CedarHighlighter.h"
 #include "CedarLexer.h"
-#include <QBuffer>
+#include "TiogaReader.h"
 using namespace Cedar;
 
 Highlighter::Highlighter(QTextDocument* parent) :
@@ -29,7 +29,7 @@ Highlighter::Highlighter(QTextDocument* parent) :
 {
     for( int i = 0; i < C_Max; i++ )
     {
-        d_format[i].setFontWeight(QFont::Normal);
+        // no explicit font weight so the document char formats (i.e. Tioga looks) show through
         d_format[i].setForeground(Qt::black);
         d_format[i].setBackground(Qt::transparent);
     }
@@ -60,6 +60,26 @@ void Highlighter::addKeyword(const QByteArray& kw)
     d_keywords << kw;
 }
 
+void Highlighter::setComments(const QString& code, const QVector<TiogaSpan>& spans)
+{
+    d_commentCol.clear();
+    int line = 0, lineStart = 0, pos = 0;
+    foreach( const TiogaSpan& s, spans )
+    {
+        if( !( s.flags & TiogaSpan::Comment ) )
+            continue;
+        for( ; pos < int(s.pos) && pos < code.size(); pos++ )
+        {
+            if( code[pos] == '\n' )
+            {
+                line++;
+                lineStart = pos + 1;
+            }
+        }
+        d_commentCol.insert(line, s.pos - lineStart);
+    }
+}
+
 QTextCharFormat Highlighter::formatForCategory(int c) const
 {
     return d_format[c];
@@ -101,15 +121,25 @@ void Highlighter::highlightBlock(const QString& text)
         }
     }
 
+    // comment lines of the Tioga file are known and not scanned
+    int end = text.size();
+    const int cmt = d_commentCol.value(currentBlock().blockNumber(), -1);
+    if( cmt >= start )
+    {
+        setFormat( cmt, text.size() - cmt, formatForCategory(C_Cmt) );
+        end = cmt;
+    }
+
     Cedar::Lexer lex;
     lex.setIgnoreComments(false);
     lex.setPackComments(false);
+    lex.setCopyValues(false);
+    lex.setStream(text.mid(start, end - start));
 
-    QList<Token> tokens = lex.tokens(text.mid(start));
-    for( int i = 0; i < tokens.size(); ++i )
+    for( Token t = lex.nextToken(); t.isValid(); t = lex.nextToken() )
     {
-        Token &t = tokens[i];
         t.d_colNr += start;
+        const QByteArray val = lex.text(t);
 
         QTextCharFormat f;
         if( t.d_type == Tok_Comment )
@@ -118,7 +148,7 @@ void Highlighter::highlightBlock(const QString& text)
         {
             f = formatForCategory(C_Cmt);
             lexerState = 1;
-            if( t.d_val.endsWith(">>") )
+            if( val.endsWith(">>") )
                 lexerState = 0;
             else
                 braceDepth++;
@@ -136,9 +166,9 @@ void Highlighter::highlightBlock(const QString& text)
         {
             /*if( i+1 < tokens.size() && tokens[i+1].d_type == Tok_Colon)
                 f = formatForCategory(C_Label);
-            else */if( d_builtins.contains(t.d_val) )
+            else */if( d_builtins.contains(val) )
                 f = formatForCategory(C_Type);
-            else if( d_keywords.contains(t.d_val) )
+            else if( d_keywords.contains(val) )
                 f = formatForCategory(C_Kw);
             else
                 f = formatForCategory(C_Ident);
@@ -146,10 +176,10 @@ void Highlighter::highlightBlock(const QString& text)
             f = formatForCategory(C_Sym);
 
         /*if( lexerState == 3 )
-            setFormat( startPp, t.d_colNr - startPp + t.d_val.size(), formatForCategory(C_Pp) );
+            setFormat( startPp, t.d_colNr - startPp + t.d_len, formatForCategory(C_Pp) );
         else */
         if( f.isValid() )
-            setFormat( t.d_colNr-1, t.d_val.isEmpty() ? t.d_len : t.d_val.size(), f );
+            setFormat( t.d_colNr-1, t.d_len, f );
     }
 
     setCurrentBlockState((braceDepth << 8) | lexerState );
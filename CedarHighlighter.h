@@ -22,6 +22,10 @@
 
 #include <QSyntaxHighlighter>
 #include <QSet>
+#include <QHash>
+#include <QVector>
+
+struct TiogaSpan;
 
 namespace Cedar
 {
@@ -32,6 +36,8 @@ namespace Cedar
         explicit Highlighter(QTextDocument *parent = 0);
         void addBuiltIn(const QByteArray& bi);
         void addKeyword(const QByteArray& kw);
+        // before the code is set to the document: the comment lines TiogaReader found in it
+        void setComments(const QString& code, const QVector<TiogaSpan>& spans);
 
     protected:
         QTextCharFormat formatForCategory(int) const;
@@ -43,6 +49,7 @@ namespace Cedar
         enum Category { C_Num, C_Str, C_Kw, C_Type, C_Ident, C_Op, C_Pp, C_Cmt, C_Label, C_Sym, C_Max };
         QTextCharFormat d_format[C_Max];
         QSet<QByteArray> d_builtins, d_keywords;
+        QHash<int,int> d_commentCol; // block number -> start of the comment to the end of the line
     };
 
     class LogPainter : public QSyntaxHighlighter
@@ -0,0 +1,185 @@
+// This file was automatically generated by syntax/gen_keywords.py; don't modify it!
+#include "CedarKeywords.h"
+#include <string.h>
+
+namespace Cedar {
+
+	enum { ckw_SlotBits = 10, ckw_MinLen = 2, ckw_MaxLen = 11 };
+	static const quint32 ckw_seed = 462079917u;
+
+	struct ckw_Keyword { const char* str; quint8 len; quint8 type; };
+
+	static const ckw_Keyword ckw_keywords[] = {
+		{ "", 0, Tok_Invalid },
+		{ "ABS", 3, Tok_ABS },
+		{ "ALL", 3, Tok_ALL },
+		{ "AND", 3, Tok_AND },
+		{ "ANY", 3, Tok_ANY },
+		{ "APPLY", 5, Tok_APPLY },
+		{ "ARRAY", 5, Tok_ARRAY },
+		{ "BASE", 4, Tok_BASE },
+		{ "BEGIN", 5, Tok_BEGIN },
+		{ "BROADCAST", 9, Tok_BROADCAST },
+		{ "CEDAR", 5, Tok_CEDAR },
+		{ "CHECKED", 7, Tok_CHECKED },
+		{ "CODE", 4, Tok_CODE },
+		{ "COMPUTED", 8, Tok_COMPUTED },
+		{ "CONS", 4, Tok_CONS },
+		{ "CONTINUE", 8, Tok_CONTINUE },
+		{ "DECREASING", 10, Tok_DECREASING },
+		{ "DEFINITIONS", 11, Tok_DEFINITIONS },
+		{ "DEPENDENT", 9, Tok_DEPENDENT },
+		{ "DESCRIPTOR", 10, Tok_DESCRIPTOR },
+		{ "DIRECTORY", 9, Tok_DIRECTORY },
+		{ "DO", 2, Tok_DO },
+		{ "ELSE", 4, Tok_ELSE },
+		{ "ENABLE", 6, Tok_ENABLE },
+		{ "END", 3, Tok_END },
+		{ "ENDCASE", 7, Tok_ENDCASE },
+		{ "ENDLOOP", 7, Tok_ENDLOOP },
+		{ "ENTRY", 5, Tok_ENTRY },
+		{ "ERROR", 5, Tok_ERROR },
+		{ "EXIT", 4, Tok_EXIT },
+		{ "EXITS", 5, Tok_EXITS },
+		{ "EXPORTS", 7, Tok_EXPORTS },
+		{ "FINISHED", 8, Tok_FINISHED },
+		{ "FIRST", 5, Tok_FIRST },
+		{ "FOR", 3, Tok_FOR },
+		{ "FORK", 4, Tok_FORK },
+		{ "FRAME", 5, Tok_FRAME },
+		{ "FREE", 4, Tok_FREE },
+		{ "FROM", 4, Tok_FROM },
+		{ "GO", 2, Tok_GO },
+		{ "GOTO", 4, Tok_GOTO },
+		{ "IF", 2, Tok_IF },
+		{ "IMPORTS", 7, Tok_IMPORTS },
+		{ "IN", 2, Tok_IN },
+		{ "INLINE", 6, Tok_INLINE },
+		{ "INTERNAL", 8, Tok_INTERNAL },
+		{ "ISTYPE", 6, Tok_ISTYPE },
+		{ "JOIN", 4, Tok_JOIN },
+		{ "LAST", 4, Tok_LAST },
+		{ "LENGTH", 6, Tok_LENGTH },
+		{ "LIST", 4, Tok_LIST },
+		{ "LOCKS", 5, Tok_LOCKS },
+		{ "LONG", 4, Tok_LONG },
+		{ "LOOP", 4, Tok_LOOP },
+		{ "LOOPHOLE", 8, Tok_LOOPHOLE },
+		{ "MACHINE", 7, Tok_MACHINE },
+		{ "MAX", 3, Tok_MAX },
+		{ "MIN", 3, Tok_MIN },
+		{ "MOD", 3, Tok_MOD },
+		{ "MONITOR", 7, Tok_MONITOR },
+		{ "MONITORED", 9, Tok_MONITORED },
+		{ "NARROW", 6, Tok_NARROW },
+		{ "NEW", 3, Tok_NEW },
+		{ "NIL", 3, Tok_NIL },
+		{ "NOT", 3, Tok_NOT },
+		{ "NOTIFY", 6, Tok_NOTIFY },
+		{ "NULL", 4, Tok_NULL },
+		{ "OF", 2, Tok_OF },
+		{ "OPEN", 4, Tok_OPEN },
+		{ "OR", 2, Tok_OR },
+		{ "ORD", 3, Tok_ORD },
+		{ "ORDERED", 7, Tok_ORDERED },
+		{ "OVERLAID", 8, Tok_OVERLAID },
+		{ "PACKED", 6, Tok_PACKED },
+		{ "PAINTED", 7, Tok_PAINTED },
+		{ "POINTER", 7, Tok_POINTER },
+		{ "PORT", 4, Tok_PORT },
+		{ "PRED", 4, Tok_PRED },
+		{ "PRIVATE", 7, Tok_PRIVATE },
+		{ "PROC", 4, Tok_PROC },
+		{ "PROCEDURE", 9, Tok_PROCEDURE },
+		{ "PROCESS", 7, Tok_PROCESS },
+		{ "PROGRAM", 7, Tok_PROGRAM },
+		{ "PUBLIC", 6, Tok_PUBLIC },
+		{ "READONLY", 8, Tok_READONLY },
+		{ "RECORD", 6, Tok_RECORD },
+		{ "REF", 3, Tok_REF },
+		{ "REJECT", 6, Tok_REJECT },
+		{ "RELATIVE", 8, Tok_RELATIVE },
+		{ "REPEAT", 6, Tok_REPEAT },
+		{ "RESTART", 7, Tok_RESTART },
+		{ "RESUME", 6, Tok_RESUME },
+		{ "RETRY", 5, Tok_RETRY },
+		{ "RETURN", 6, Tok_RETURN },
+		{ "RETURNS", 7, Tok_RETURNS },
+		{ "SAFE", 4, Tok_SAFE },
+		{ "SELECT", 6, Tok_SELECT },
+		{ "SEQUENCE", 8, Tok_SEQUENCE },
+		{ "SHARES", 6, Tok_SHARES },
+		{ "SIGNAL", 6, Tok_SIGNAL },
+		{ "SIZE", 4, Tok_SIZE },
+		{ "START", 5, Tok_START },
+		{ "STATE", 5, Tok_STATE },
+		{ "STOP", 4, Tok_STOP },
+		{ "SUCC", 4, Tok_SUCC },
+		{ "THEN", 4, Tok_THEN },
+		{ "THROUGH", 7, Tok_THROUGH },
+		{ "TO", 2, Tok_TO },
+		{ "TRANSFER", 8, Tok_TRANSFER },
+		{ "TRASH", 5, Tok_TRASH },
+		{ "TRUSTED", 7, Tok_TRUSTED },
+		{ "TYPE", 4, Tok_TYPE },
+		{ "UNCHECKED", 9, Tok_UNCHECKED },
+		{ "UNCOUNTED", 9, Tok_UNCOUNTED },
+		{ "UNSAFE", 6, Tok_UNSAFE },
+		{ "UNTIL", 5, Tok_UNTIL },
+		{ "USING", 5, Tok_USING },
+		{ "VAL", 3, Tok_VAL },
+		{ "VAR", 3, Tok_VAR },
+		{ "WAIT", 4, Tok_WAIT },
+		{ "WHILE", 5, Tok_WHILE },
+		{ "WITH", 4, Tok_WITH },
+		{ "ZONE", 4, Tok_ZONE },
+	};
+
+	// index into ckw_keywords by the hash, 0 for none
+	static const quint8 ckw_slots[1024] = {
+		0,0,0,0,103,0,71,0,3,106,25,0,0,0,0,0,0,0,115,0,0,0,0,5,0,0,0,0,0,0,100,0,
+		0,0,76,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,64,0,0,0,0,0,0,0,0,0,0,0,0,30,
+		0,0,0,54,0,0,0,0,0,0,0,0,89,0,0,86,0,0,44,0,0,0,0,0,0,0,0,0,0,0,0,0,
+		116,0,0,0,0,0,0,93,0,0,0,0,0,0,0,0,0,91,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+		0,0,63,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,80,0,49,0,0,0,0,
+		0,0,81,0,0,0,0,0,0,0,0,0,0,79,0,0,0,0,0,0,0,11,0,0,0,66,0,0,0,0,0,0,
+		0,0,105,0,31,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,13,0,52,0,0,0,47,0,0,0,117,0,
+		0,0,0,0,0,27,0,0,0,0,0,122,0,0,72,0,0,0,0,0,0,0,118,0,34,0,0,0,83,0,0,0,
+		61,0,0,0,0,0,0,0,0,0,0,60,0,0,82,0,0,0,0,67,0,120,0,0,48,0,85,0,0,0,32,0,
+		0,119,0,40,0,0,0,0,0,0,0,0,0,0,0,0,88,0,0,0,37,0,0,0,21,0,0,0,0,0,0,0,
+		0,0,0,7,0,0,0,0,0,0,0,84,0,0,0,0,0,0,0,0,0,0,0,0,29,0,0,0,0,0,0,0,
+		0,0,0,69,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,95,
+		0,0,0,0,0,0,0,0,55,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+		0,0,0,0,0,0,0,0,0,0,0,65,42,0,0,0,0,0,0,0,0,0,0,75,39,0,0,0,0,0,0,0,
+		0,0,53,0,0,0,0,0,0,0,0,0,0,0,113,0,0,0,0,0,87,0,0,0,0,0,0,0,0,0,0,0,
+		0,0,0,0,38,0,0,10,0,0,0,0,0,36,0,0,0,0,0,0,0,114,0,0,0,94,0,0,0,57,0,0,
+		0,0,0,0,0,0,0,102,0,0,0,0,0,0,0,0,0,0,0,0,0,0,20,0,0,0,0,0,0,0,0,0,
+		0,0,0,0,78,0,0,0,0,0,0,0,0,121,0,0,0,0,0,43,0,0,23,0,0,96,28,0,0,109,0,0,
+		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,41,0,0,0,0,0,0,0,0,8,0,0,0,
+		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,50,0,0,0,0,
+		0,77,0,0,0,18,0,0,0,19,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+		0,0,0,46,0,0,0,90,0,0,0,0,0,0,15,0,0,0,0,0,0,0,0,0,107,0,0,101,0,0,68,0,
+		0,0,0,0,0,0,0,0,0,0,0,0,104,0,0,0,45,0,0,0,0,0,0,0,2,0,0,0,0,0,0,0,
+		0,0,0,0,0,51,0,26,0,0,0,0,0,0,110,70,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+		0,0,0,0,17,0,0,0,0,0,0,0,0,108,0,0,0,0,0,0,99,0,0,0,0,0,0,0,73,0,0,0,
+		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,62,0,0,0,0,0,56,0,6,0,0,0,0,0,35,0,0,
+		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,16,0,0,0,0,0,0,0,0,74,0,0,0,0,0,0,
+		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,0,0,24,0,0,0,0,0,0,
+		0,0,0,0,0,0,0,12,0,0,0,22,0,0,0,0,0,0,0,98,0,58,92,0,0,0,0,0,0,0,0,0,
+		0,0,0,0,59,0,0,0,0,0,0,0,0,97,0,0,0,0,112,0,0,0,0,0,0,0,0,0,4,0,14,9,
+		0,0,0,0,0,0,0,111,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,33,0,0,
+		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	};
+
+	TokenType keywordType( const char* str, int len ) {
+		if( len < ckw_MinLen || len > ckw_MaxLen || str[0] < 'A' || str[0] > 'Z' )
+			return Tok_Invalid;
+		quint32 h = ckw_seed;
+		for( int i = 0; i < len; i++ )
+			h = ( h ^ quint8(str[i]) ) * 16777619u;
+		const ckw_Keyword& k = ckw_keywords[ ckw_slots[ h >> ( 32 - ckw_SlotBits ) ] ];
+		if( k.len == len && ::memcmp( k.str, str, len ) == 0 )
+			return TokenType(k.type);
+		return Tok_Invalid;
+	}
+}
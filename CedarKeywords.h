@@ -0,0 +1,11 @@
+#ifndef CEDARKEYWORDS_H
+#define CEDARKEYWORDS_H
+// This file was automatically generated by syntax/gen_keywords.py; don't modify it!
+
+#include <CedarTokenType.h>
+
+namespace Cedar {
+	// the keyword spelled exactly (case sensitive) by str and len, or Tok_Invalid
+	TokenType keywordType( const char* str, int len );
+}
+#endif // CEDARKEYWORDS_H
@@ -15,49 +15,181 @@
 */
 
 #include "CedarLexer.h"
-#include <QBuffer>
+#include "CedarKeywords.h"
+#include "TiogaReader.h"
 #include <QtDebug>
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define CLEX_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 using namespace Cedar;
 
+// Character classes of the Latin-1 bytes; only ASCII letters, digits and white space count, as
+// in the C locale, and unlike ::isalpha etc. the table is defined for bytes >= 0x80 too
+enum { clex_Alpha = 1, clex_Digit = 2, clex_Space = 4, clex_Alnum = clex_Alpha | clex_Digit };
+
+static const quint8 clex_class[256] = {
+    0,0,0,0,0,0,0,0,0,4,4,4,4,4,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    4,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    2,2,2,2,2,2,2,2,2,2,0,0,0,0,0,0,
+    0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+    1,1,1,1,1,1,1,1,1,1,1,0,0,0,0,0,
+    0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+    1,1,1,1,1,1,1,1,1,1,1,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+};
+
+static inline bool clex_is( int ch, int cls )
+{
+    return clex_class[quint8(ch)] & cls;
+}
+
+#ifdef CLEX_SSE2
+static inline int clex_ctz( quint32 v )
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward( &i, v );
+    return i;
+#else
+    return __builtin_ctz( v );
+#endif
+}
+
+static inline __m128i clex_inRange( __m128i x, char lo, char hi )
+{
+    // signed compares; bytes >= 0x80 are negative and never in an ASCII range
+    return _mm_and_si128( _mm_cmpgt_epi8( x, _mm_set1_epi8( lo - 1 ) ),
+                          _mm_cmplt_epi8( x, _mm_set1_epi8( hi + 1 ) ) );
+}
+
+// one bit per byte of p[0..15] which is of the class
+static inline quint32 clex_mask16( const char* p, int cls )
+{
+    const __m128i x = _mm_loadu_si128( (const __m128i*)p );
+    __m128i m = _mm_setzero_si128();
+    if( cls & clex_Digit )
+        m = _mm_or_si128( m, clex_inRange( x, '0', '9' ) );
+    if( cls & clex_Alpha )
+        // with bit 5 set, 'A'..'Z' fall on 'a'..'z' and no other byte does
+        m = _mm_or_si128( m, clex_inRange( _mm_or_si128( x, _mm_set1_epi8( 0x20 ) ), 'a', 'z' ) );
+    if( cls & clex_Space )
+        m = _mm_or_si128( m, _mm_or_si128( _mm_cmpeq_epi8( x, _mm_set1_epi8( ' ' ) ),
+                                           clex_inRange( x, '\t', '\r' ) ) );
+    return _mm_movemask_epi8( m );
+}
+#endif
+
+// the position of the first byte in str[from..to) which is not of the class, or to
+static inline int clex_scan( const char* str, int from, int to, int cls )
+{
+    int i = from;
+#ifdef CLEX_SSE2
+    // 16 bytes at a time as long as they are within str; the rest byte by byte
+    while( i + 16 <= to )
+    {
+        const quint32 other = ~clex_mask16( str + i, cls ) & 0xffff;
+        if( other )
+            return i + clex_ctz( other );
+        i += 16;
+    }
+#endif
+    while( i < to && clex_is( str[i], cls ) )
+        i++;
+    return i;
+}
+
 const char Lexer::negSym = 0xac; // '¬'
 
 Lexer::Lexer():
-    d_lastToken(Tok_Invalid),d_lineNr(0),d_colNr(0),d_in(0),
-    d_ignoreComments(true), d_packComments(true),d_sloc(0),d_lineCounted(false)
+    d_lastToken(Tok_Invalid),d_lineNr(0),d_colNr(0),d_buf(0),d_size(0),d_line(""),d_lineLen(0),d_sourceId(0),
+    d_ignoreComments(true), d_packComments(true),d_copyValues(true),d_sloc(0),d_lineCounted(false),
+    d_nextComment(0),d_commentCol(-1),d_lineStart(0),d_nextLineStart(0),d_bufHead(0)
 {
 
 }
 
 Lexer::~Lexer()
 {
-    if( d_in )
-        delete d_in;
 }
 
 void Lexer::setStream(QString code, const QString& filePath)
 {
-    if( d_in )
-        delete d_in;
-    QBuffer* buf = new QBuffer();
     code.replace("←", QChar(negSym) );
-    buf->setData( code.toLatin1() );
-    buf->open(QIODevice::ReadOnly);
-    d_in = buf;
+    d_code = code.toLatin1();
+    start(d_code.constData(), d_code.size(), filePath);
+}
+
+void Lexer::setBuffer(const char* data, int len, const QString& filePath)
+{
+    d_code.clear();
+    start(data, len, filePath);
+}
+
+void Lexer::start(const char* data, int len, const QString& filePath)
+{
+    d_buf = data;
+    d_size = len;
+    // keyword and operator matching runs directly on the buffer
+    d_all = QByteArray::fromRawData(data, len);
+    d_line = "";
+    d_lineLen = 0;
+    d_buffer.resize(0);
+    d_bufHead = 0;
     d_lineNr = 0;
     d_colNr = 0;
     d_lastToken = Tok_Invalid;
-    d_filePath = filePath;
+    d_sourceId = Token::toSourceId(filePath);
     d_sloc = 0;
     d_lineCounted = false;
+    d_comments.clear();
+    d_nextComment = 0;
+    d_commentCol = -1;
+    d_lineStart = 0;
+    d_nextLineStart = 0;
+}
+
+void Lexer::setComments(const QVector<TiogaSpan>& spans)
+{
+    d_comments.clear();
+    foreach( const TiogaSpan& s, spans )
+    {
+        if( s.flags & TiogaSpan::Comment )
+            d_comments.append(s);
+    }
+    d_nextComment = 0;
+}
+
+QByteArray Lexer::text(const Token& t) const
+{
+    if( d_buf == 0 || t.d_off + t.d_len > d_size )
+        return QByteArray();
+    return QByteArray::fromRawData(d_buf + t.d_off, t.d_len);
 }
 
 Token Lexer::nextToken()
 {
     Token t;
-    if( !d_buffer.isEmpty() )
+    if( d_bufHead < d_buffer.size() )
     {
-        t = d_buffer.first();
-        d_buffer.pop_front();
+        t = d_buffer[d_bufHead++];
+        if( d_bufHead == d_buffer.size() )
+        {
+            d_buffer.resize(0); // keeps the capacity
+            d_bufHead = 0;
+        }
     }else
         t = nextTokenImp();
     while( t.d_type == Tok_Comment && d_ignoreComments )
@@ -68,14 +200,14 @@ Token Lexer::nextToken()
 Token Lexer::peekToken(quint8 lookAhead)
 {
     Q_ASSERT( lookAhead > 0 );
-    while( d_buffer.size() < lookAhead )
+    while( d_buffer.size() - d_bufHead < lookAhead )
     {
         Token t = nextTokenImp();
         while( t.d_type == Tok_Comment && d_ignoreComments )
             t = nextTokenImp();
         d_buffer.push_back( t );
     }
-    return d_buffer[ lookAhead - 1 ];
+    return d_buffer[ d_bufHead + lookAhead - 1 ];
 }
 
 QList<Token> Lexer::tokens(QString code)
@@ -94,53 +226,60 @@ QList<Token> Lexer::tokens(QString code)
 
 Token Lexer::nextTokenImp()
 {
-    if( d_in == 0 )
+    if( d_buf == 0 )
         return token(Tok_Eof);
     skipWhiteSpace();
 
-    while( d_colNr >= d_line.size() )
+    forever
     {
-        if( d_in->atEnd() )
+        while( d_colNr >= d_lineLen )
         {
-            Token t = token( Tok_Eof, 0 );
-            return t;
+            if( atEnd() )
+            {
+                Token t = token( Tok_Eof, 0 );
+                return t;
+            }
+            nextLine();
+            skipWhiteSpace();
         }
-        nextLine();
-        skipWhiteSpace();
+        if( d_commentCol < 0 || d_colNr < d_commentCol )
+            break;
+        // the rest of the line is known to be a comment
+        const int len = d_lineLen - d_colNr;
+        if( !d_ignoreComments )
+            return spanToken( Tok_Comment, len );
+        d_colNr += len;
     }
-    Q_ASSERT( d_colNr < d_line.size() );
-    while( d_colNr < d_line.size() )
+    Q_ASSERT( d_colNr < d_lineLen );
+    while( d_colNr < d_lineLen )
     {
         const char ch = quint8(d_line[d_colNr]);
 
         if( ch == '"' )
             return string();
         else if( ch == negSym || ch == '_' )
-            return token( Tok_2190, 1, "_" );
+            return token( Tok_2190, 1, d_copyValues ? QByteArray("_") : QByteArray() );
         else if( ch == '\'')
             return character();
         else if( ch == '$')
             return symbol();
-        else if( ::isalpha(ch) )
+        else if( clex_is(ch, clex_Alpha) )
             return ident();
-        else if( ::isdigit(ch) )
+        else if( clex_is(ch, clex_Digit) )
             return number();
         // else
-        int pos = d_colNr;
-        TokenType tt = tokenTypeFromString(d_line,&pos);
+        const int start = d_lineStart + d_colNr;
+        int pos = start;
+        TokenType tt = tokenTypeFromString(d_all,&pos);
 
         if( tt == Tok_2Lt )
             return comment();
         else if( tt == Tok_2Minus )
-        {
-            const int len = d_line.size() - d_colNr;
-            return token( Tok_Comment, len, d_line.mid(d_colNr,len) );
-        }else if( tt == Tok_Invalid || pos == d_colNr )
+            return spanToken( Tok_Comment, d_lineLen - d_colNr );
+        else if( tt == Tok_Invalid || pos == start )
             return token( Tok_Invalid, 1, QString("unexpected character '%1' %2").arg(char(ch)).arg(int(ch)).toUtf8() );
-        else {
-            const int len = pos - d_colNr;
-            return token( tt, len, d_line.mid(d_colNr,len) );
-        }
+        else
+            return spanToken( tt, pos - start );
     }
     Q_ASSERT(false);
     return token(Tok_Invalid);
@@ -149,8 +288,7 @@ Token Lexer::nextTokenImp()
 int Lexer::skipWhiteSpace()
 {
     const int colNr = d_colNr;
-    while( d_colNr < d_line.size() && ::isspace( d_line[d_colNr] ) )
-        d_colNr++;
+    d_colNr = clex_scan( d_line, d_colNr, d_lineLen, clex_Space );
     return d_colNr - colNr;
 }
 
@@ -158,18 +296,29 @@ void Lexer::nextLine()
 {
     d_colNr = 0;
     d_lineNr++;
-    d_line = d_in->readLine();
     d_lineCounted = false;
-
-    if( d_line.endsWith("\r\n") )
-        d_line.chop(2);
-    else if( d_line.endsWith('\n') || d_line.endsWith('\r') )
-        d_line.chop(1);
+    // the line is only a view into the buffer
+    d_lineStart = d_nextLineStart;
+    d_line = d_buf + d_lineStart;
+    const char* nl = (const char*)::memchr(d_line, '\n', d_size - d_lineStart);
+    const int len = nl ? nl - d_line + 1 : d_size - d_lineStart;
+    d_nextLineStart += len;
+    d_lineLen = len;
+    if( d_lineLen > 0 && d_line[d_lineLen-1] == '\n' )
+        d_lineLen--;
+    if( d_lineLen > 0 && d_line[d_lineLen-1] == '\r' )
+        d_lineLen--;
+
+    d_commentCol = -1;
+    while( d_nextComment < d_comments.size() && d_comments[d_nextComment].pos < d_lineStart )
+        d_nextComment++;
+    if( d_nextComment < d_comments.size() && d_comments[d_nextComment].pos < d_lineStart + d_lineLen )
+        d_commentCol = d_comments[d_nextComment].pos - d_lineStart;
 }
 
 int Lexer::lookAhead(int off) const
 {
-    if( int( d_colNr + off ) < d_line.size() )
+    if( int( d_colNr + off ) < d_lineLen )
     {
         return d_line[ d_colNr + off ];
     }else
@@ -181,43 +330,35 @@ Token Lexer::token(TokenType tt, int len, const QByteArray& val)
     if( tt != Tok_Invalid && tt != Tok_Comment && tt != Tok_Eof )
         countLine();
     Token t( tt, d_lineNr, d_colNr + 1, val );
-    d_lastToken = t;
-    d_colNr += len;
+    t.d_off = d_lineStart + d_colNr;
     t.d_len = len;
-#if 1
     if( tt == Tok_n )
-        t.d_id = Token::toId(val);
-#endif
-    t.d_sourcePath = d_filePath;
+        t.d_id = Token::toId(d_line + d_colNr, len); // interned in place, without a copy
+    t.d_sourceId = d_sourceId;
+    d_colNr += len;
+    d_lastToken = t;
     return t;
 }
 
+Token Lexer::spanToken(TokenType tt, int len)
+{
+    // the text of the token is d_off and d_len in the buffer; d_val is only a copy of it
+    return token( tt, len, d_copyValues ? QByteArray(d_line + d_colNr, len) : QByteArray() );
+}
+
 Token Lexer::ident()
 {
-    int off = 1;
-    while( true )
-    {
-        const char c = lookAhead(off);
-        if( !::isalnum(c) )
-            break;
-        else
-            off++;
-    }
-    const QByteArray str = d_line.mid(d_colNr, off );
-    Q_ASSERT( !str.isEmpty() );
-    int pos = 0;
-    TokenType t = tokenTypeFromString( str, &pos );
-    if( t != Tok_Invalid && pos != str.size() )
-        t = Tok_Invalid;
+    const int off = clex_scan( d_line, d_colNr + 1, d_lineLen, clex_Alnum ) - d_colNr;
+    const TokenType t = keywordType( d_line + d_colNr, off );
     if( t != Tok_Invalid )
         return token( t, off );
     else
-        return token( Tok_n, off, str );
+        return spanToken( Tok_n, off );
 }
 
 static inline bool isHexDigit( char c )
 {
-    return ::isdigit(c) || c == 'A' || c == 'B' || c == 'C' || c == 'D' || c == 'E' || c == 'F'
+    return clex_is(c, clex_Digit) || c == 'A' || c == 'B' || c == 'C' || c == 'D' || c == 'E' || c == 'F'
             || c == 'a' || c == 'b' || c == 'c' || c == 'd' || c == 'e' || c == 'f';
 }
 
@@ -235,30 +376,15 @@ Token Lexer::number()
     // | ?num . num ?exponent
     // | num C
 
-    int off = 1;
-    while( true )
-    {
-        const char c = lookAhead(off);
-        if( !::isdigit(c) )
-            break;
-        else
-            off++;
-    }
+    int off = clex_scan( d_line, d_colNr + 1, d_lineLen, clex_Digit ) - d_colNr;
     bool isReal = false;
     if( lookAhead(off) == '.' && lookAhead(off+1) != '.' )
     {
         isReal = true;
         off++;
-        if( !::isdigit(lookAhead(off)))
+        if( !clex_is(lookAhead(off), clex_Digit) )
             return token( Tok_Invalid, off, "invalid real, digit expected after dot" );
-        while( true )
-        {
-            const char c = lookAhead(off);
-            if( !::isdigit(c) )
-                break;
-            else
-                off++;
-        }
+        off = clex_scan( d_line, d_colNr + off, d_lineLen, clex_Digit ) - d_colNr;
     }
     if( lookAhead(off) == 'E' || lookAhead(off) == 'e' )
     {
@@ -270,20 +396,11 @@ Token Lexer::number()
             off++;
             o = lookAhead(off);
         }
-        if( !::isdigit(o) )
+        if( !clex_is(o, clex_Digit) )
             return token( Tok_Invalid, off, "invalid real, digit expected after exponent" );
-        while( true )
-        {
-            const char c = lookAhead(off);
-            if( !::isdigit(c) )
-                break;
-            else
-                off++;
-        }
+        off = clex_scan( d_line, d_colNr + off, d_lineLen, clex_Digit ) - d_colNr;
     }
-    const QByteArray str = d_line.mid(d_colNr, off );
-    Q_ASSERT( !str.isEmpty() );
-    return token( Tok_number, off, str );
+    return spanToken( Tok_number, off );
 }
 
 Token Lexer::symbol()
@@ -291,69 +408,63 @@ Token Lexer::symbol()
     // hex_digit_sequence ::= // '$' hex_digit { hex_digit }
     // hex_digit ::= digit | 'A'..'F'
 
-    int off = 1;
-    while( true )
-    {
-        const char c = lookAhead(off);
-        if( !::isalnum(c) )
-            break;
-        else
-            off++;
-    }
-    const QByteArray str = d_line.mid(d_colNr, off );
-    Q_ASSERT( !str.isEmpty() );
-    return token( Tok_symbol, off, str );
+    const int off = clex_scan( d_line, d_colNr + 1, d_lineLen, clex_Alnum ) - d_colNr;
+    return spanToken( Tok_symbol, off );
 }
 
 Token Lexer::comment()
 {
     const int startLine = d_lineNr;
     const int startCol = d_colNr;
+    const quint32 startOff = d_lineStart + d_colNr;
     // startLine and startCol point to first char of <<
 
-    const QByteArray tag = ">>";
-    int pos = d_line.indexOf(tag,d_colNr);
-
-    QByteArray str;
-    bool terminated = false;
-    if( pos < 0 )
-        str = d_line.mid(d_colNr);
-    else
-    {
-        terminated = true;
-        pos += tag.size();
-        str = d_line.mid(d_colNr,pos-d_colNr);
-    }
-    while( !terminated && !d_in->atEnd() )
+    int pos = findEndOfComment();
+    while( pos < 0 && !atEnd() )
     {
         nextLine();
-        pos = d_line.indexOf(tag,d_colNr);
-        if( !str.isEmpty() )
-            str += '\n';
-        if( pos < 0 )
-            str += d_line.mid(d_colNr);
-        else
-        {
-            terminated = true;
-            pos += tag.size();
-            str += d_line.mid(d_colNr,pos-d_colNr);
-        }
+        pos = findEndOfComment();
     }
-    if( d_packComments && !terminated && d_in->atEnd() )
+    const bool terminated = pos >= 0;
+    if( d_packComments && !terminated && atEnd() )
     {
-        d_colNr = d_line.size();
+        d_colNr = d_lineLen;
         Token t( Tok_Invalid, startLine, startCol + 1, "non-terminated comment" );
-        t.d_sourcePath = d_filePath;
+        t.d_sourceId = d_sourceId;
         return t;
     }
+    if( terminated )
+        pos += 2;
+    else
+        pos = d_lineLen;
+    const quint32 endOff = d_lineStart + pos;
+    QByteArray str;
+    if( d_copyValues )
+    {
+        str = QByteArray(d_buf + startOff, endOff - startOff);
+        if( str.contains('\r') )
+            str.replace("\r", "");
+    }
     // Col + 1 weil wir immer bei Spalte 1 beginnen, nicht bei Spalte 0
     Token t( ( d_packComments ? Tok_Comment : Tok_2Lt ), startLine, startCol + 1, str );
+    t.d_off = startOff;
+    t.d_len = endOff - startOff;
     d_lastToken = t;
     d_colNr = pos;
-    t.d_sourcePath = d_filePath;
+    t.d_sourceId = d_sourceId;
     return t;
 }
 
+int Lexer::findEndOfComment() const
+{
+    for( int i = d_colNr; i + 1 < d_lineLen; i++ )
+    {
+        if( d_line[i] == '>' && d_line[i+1] == '>' )
+            return i;
+    }
+    return -1;
+}
+
 Token Lexer::character()
 {
     if( lookAhead(1) == '\\' )
@@ -376,15 +487,15 @@ Token Lexer::character()
         case '\'':
         case '"':
         case '\\':
-            return token( Tok_char, 3, d_line.mid(d_colNr,3) );
+            return spanToken( Tok_char, 3 );
         default:
-            if( ::isdigit(ch) && ::isdigit(lookAhead(3)) && ::isdigit(lookAhead(4)) )
-                return token( Tok_char, 5, d_line.mid(d_colNr,5) );
+            if( clex_is(ch, clex_Digit) && clex_is(lookAhead(3), clex_Digit) && clex_is(lookAhead(4), clex_Digit) )
+                return spanToken( Tok_char, 5 );
             else
-                return token( Tok_Invalid, d_colNr, "invalid character escape code" );
+                return token( Tok_Invalid, 3, "invalid character escape code" );
         }
     }else
-        return token( Tok_char, 2, d_line.mid(d_colNr,2) );
+        return spanToken( Tok_char, 2 );
 }
 
 Token Lexer::string()
@@ -404,8 +515,7 @@ Token Lexer::string()
         if( c == 0 )
             return token( Tok_Invalid, off, "non-terminated string" );
     }
-    const QByteArray str = d_line.mid(d_colNr, off );
-    return token( Tok_string, off, str );
+    return spanToken( Tok_string, off );
 }
 
 void Lexer::countLine()
@@ -19,7 +19,9 @@
 
 #include <CedarToken.h>
 #include <QList>
-#include <QIODevice>
+#include <QVector>
+
+struct TiogaSpan;
 
 namespace Cedar
 {
@@ -30,9 +32,19 @@ public:
     Lexer();
     ~Lexer();
 
-    void setStream(QString code, const QString& filePath = QString());
+    void setStream(QString code, const QString& filePath = QString()); // lexes a Latin-1 copy
+    // lexes the Latin-1 text in place; it must not change or go away while the lexer or the
+    // offsets of its tokens are used
+    void setBuffer(const char* data, int len, const QString& filePath = QString());
+    // if false, tokens don't carry a copy of their text in d_val, only d_off and d_len; this
+    // avoids a heap allocation per token
+    void setCopyValues( bool b ) { d_copyValues = b; }
+    QByteArray text(const Token&) const; // not a copy, points into the buffer
     void setIgnoreComments( bool b ) { d_ignoreComments = b; }
     void setPackComments( bool b ) { d_packComments = b; }
+    // after setStream: the comment lines found by TiogaReader (the spans of the code marked
+    // TiogaSpan::Comment); these lines are not scanned, only delivered as Tok_Comment if needed
+    void setComments( const QVector<TiogaSpan>& );
 
     Token nextToken();
     Token peekToken(quint8 lookAhead = 1);
@@ -43,9 +55,13 @@ public:
 protected:
     Token nextTokenImp();
     int skipWhiteSpace();
+    void start(const char* data, int len, const QString& filePath);
     void nextLine();
+    bool atEnd() const { return d_nextLineStart >= d_size; }
     int lookAhead(int off = 1) const;
+    int findEndOfComment() const;
     Token token(TokenType tt, int len = 1, const QByteArray &val = QByteArray());
+    Token spanToken(TokenType tt, int len);
     Token ident();
     Token number();
     Token symbol();
@@ -54,17 +70,27 @@ protected:
     Token string();
     void countLine();
 private:
-    QIODevice* d_in;
+    QByteArray d_code; // the copy made by setStream
+    QByteArray d_all; // the whole buffer, without a copy
+    const char* d_buf;
+    quint32 d_size;
     quint32 d_lineNr;
     quint16 d_colNr;
-    QByteArray d_line;
-    QList<Token> d_buffer;
+    const char* d_line; // the current line in the buffer, without the line end
+    int d_lineLen;
+    QVector<Token> d_buffer; // the tokens peeked, from d_bufHead
+    int d_bufHead;
     Token d_lastToken;
     quint32 d_sloc; // number of lines of code without empty or comment lines
-    QString d_filePath;
+    quint16 d_sourceId; // of the file path, see Token::toSourceId
     bool d_ignoreComments;  // don't deliver comment tokens
     bool d_packComments;    // Only deliver one Tok_Comment for /**/ instead of Tok_Lcmt and Tok_Rcmt
+    bool d_copyValues;
     bool d_lineCounted;
+    QVector<TiogaSpan> d_comments;
+    int d_nextComment; // index in d_comments
+    int d_commentCol; // where the comment starts in d_line, or -1
+    quint32 d_lineStart, d_nextLineStart; // offsets in the code
 };
 
 }
@@ -32,13 +32,13 @@ void Parser::RunParser()
     
 void Parser::SynErr(int n, const char* ctx) {
     if (errDist >= minErrDist)
-       SynErr(d_next.d_lineNr, d_next.d_colNr, n, ctx, QString(), d_next.d_sourcePath);
+       SynErr(d_next.d_lineNr, d_next.d_colNr, n, ctx, QString(), d_next.d_sourceId);
 	errDist = 0;
 }
 
 void Parser::SemErr(const char* msg) {
 	if (errDist >= minErrDist)
-		error(d_cur.d_lineNr, d_cur.d_colNr, msg, d_cur.d_sourcePath);
+		error(d_cur.d_lineNr, d_cur.d_colNr, msg, d_cur.d_sourceId);
 	errDist = 0;
 }
 
@@ -51,7 +51,7 @@ void Parser::Get() {
         {
         case Cedar::Tok_Invalid:
         	if( !d_next.d_val.isEmpty() )
-                error( d_next.d_lineNr, d_next.d_colNr, d_next.d_val, d_next.d_sourcePath );
+                error( d_next.d_lineNr, d_next.d_colNr, d_next.d_val, d_next.d_sourceId );
             // else errors already handeled in lexer
             break;
         case Cedar::Tok_Comment:
@@ -2724,7 +2724,7 @@ Parser::~Parser() {
 	ParserDestroyCaller<Parser>::CallDestroy(this);
 }
 
-void Parser::SynErr(int line, int col, int n, const char* ctx, const QString& str, const QString& path ) {
+void Parser::SynErr(int line, int col, int n, const char* ctx, const QString& str, quint16 sourceId ) {
 	QString s;
 	QString ctxStr;
 	if( ctx )
@@ -2971,7 +2971,7 @@ void Parser::SynErr(int line, int col, int n, const char* ctx, const QString& st
 	}
     if( !str.isEmpty() )
         s = QString("%1 %2").arg(s).arg(str);
-	error(line, col, s, path);
+	error(line, col, s, sourceId);
 	//count++;
 }
 
@@ -197,7 +197,7 @@ private:
 	bool StartOf(int s);
 	void ExpectWeak(int n, int follow);
 	bool WeakSeparator(int n, int syFol, int repFol);
-    void SynErr(int line, int col, int n, const char* ctx, const QString&, const QString& path );
+    void SynErr(int line, int col, int n, const char* ctx, const QString&, quint16 sourceId );
 
 public:
 	Lexer *scanner;
@@ -205,17 +205,18 @@ public:
 	{
 		QString msg;
 		int row, col;
-		QString path;
+		quint16 sourceId;
+		QString path() const { return Token::sourcePath(sourceId); }
 	};
 	QList<Error> errors;
 	
-	void error(int row, int col, const QString& msg, const QString& path)
+	void error(int row, int col, const QString& msg, quint16 sourceId)
 	{
 		Error e;
 		e.row = row;
 		e.col = col;
 		e.msg = msg;
-		e.path = path;
+		e.sourceId = sourceId;
 		errors.append(e);
 	}
 
@@ -17,18 +17,146 @@
 
 #include "CedarToken.h"
 #include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <QVector>
 #include <QtDebug>
+#include <stdlib.h>
 
-static QHash<QByteArray,QByteArray> d_symbols;
+// The identifiers are interned in shards chosen by their hash, each with its own lock, so
+// lexers on many threads seldom wait for each other. The lower-case copies are kept in chunks
+// which are never freed; the pointers stay valid and equal identifiers have equal pointers.
+enum { ShardBits = 4, ShardCount = 1 << ShardBits, ChunkSize = 64 * 1024 };
+
+static inline char ctok_lower( char c )
+{
+    return c >= 'A' && c <= 'Z' ? c + ( 'a' - 'A' ) : c;
+}
+
+static inline quint32 ctok_hash( const char* str, int len )
+{
+    quint32 h = 2166136261u; // FNV-1a
+    for( int i = 0; i < len; i++ )
+    {
+        h ^= quint8(ctok_lower(str[i]));
+        h *= 16777619u;
+    }
+    return h;
+}
+
+struct ctok_Shard
+{
+    QMutex lock;
+    QVector<const char*> slots; // open addressing, the size is a power of two
+    QVector<quint32> hashes;
+    int count;
+    char* chunk;
+    int chunkLeft;
+    ctok_Shard():count(0),chunk(0),chunkLeft(0){}
+
+    static bool equals( const char* sym, const char* str, int len )
+    {
+        for( int i = 0; i < len; i++ )
+        {
+            if( sym[i] != ctok_lower(str[i]) )
+                return false;
+        }
+        return sym[len] == 0;
+    }
+    char* alloc( int len )
+    {
+        if( len > ChunkSize / 4 )
+            return (char*)::malloc(len);
+        if( len > chunkLeft )
+        {
+            chunk = (char*)::malloc(ChunkSize);
+            chunkLeft = ChunkSize;
+        }
+        char* res = chunk;
+        chunk += len;
+        chunkLeft -= len;
+        return res;
+    }
+    void grow()
+    {
+        const QVector<const char*> oldSlots = slots;
+        const QVector<quint32> oldHashes = hashes;
+        const int size = slots.isEmpty() ? 256 : slots.size() * 2;
+        slots.fill(0, size);
+        hashes.fill(0, size);
+        for( int i = 0; i < oldSlots.size(); i++ )
+        {
+            if( oldSlots[i] == 0 )
+                continue;
+            int j = oldHashes[i] & ( size - 1 );
+            while( slots[j] != 0 )
+                j = ( j + 1 ) & ( size - 1 );
+            slots[j] = oldSlots[i];
+            hashes[j] = oldHashes[i];
+        }
+    }
+    const char* intern( const char* str, int len, quint32 h )
+    {
+        QMutexLocker locker(&lock);
+        if( 2 * ( count + 1 ) > slots.size() )
+            grow();
+        const int mask = slots.size() - 1;
+        int i = h & mask;
+        while( slots[i] != 0 )
+        {
+            if( hashes[i] == h && equals(slots[i], str, len) )
+                return slots[i];
+            i = ( i + 1 ) & mask;
+        }
+        char* sym = alloc(len + 1);
+        for( int j = 0; j < len; j++ )
+            sym[j] = ctok_lower(str[j]);
+        sym[len] = 0;
+        slots[i] = sym;
+        hashes[i] = h;
+        count++;
+        return sym;
+    }
+};
+
+static ctok_Shard s_symbols[ShardCount];
+static QHash<QString,quint16> d_sourceIds;
+static QStringList d_sourcePaths; // index is id - 1
+static QMutex d_sourceLock; // lexers run in parallel in TiogaBatch
 
 
 const char* Cedar::Token::toId(const QByteArray& ident)
 {
-    if( ident.isEmpty() )
+    return toId(ident.constData(), ident.size());
+}
+
+const char* Cedar::Token::toId(const char* str, int len)
+{
+    if( len <= 0 )
         return "";
-    const QByteArray lc = ident.toLower();
-    QByteArray& sym = d_symbols[lc];
-    if( sym.isEmpty() )
-        sym = lc;
-    return sym.constData();
+    const quint32 h = ctok_hash(str, len);
+    // the low bits select the slot in the shard, the high bits the shard
+    return s_symbols[h >> ( 32 - ShardBits )].intern(str, len, h);
+}
+
+quint16 Cedar::Token::toSourceId(const QString& path)
+{
+    if( path.isEmpty() )
+        return 0;
+    QMutexLocker lock(&d_sourceLock);
+    quint16& id = d_sourceIds[path];
+    if( id == 0 && d_sourcePaths.size() < 0xffff )
+    {
+        d_sourcePaths.append(path);
+        id = d_sourcePaths.size();
+    }
+    return id;
+}
+
+QString Cedar::Token::sourcePath(quint16 id)
+{
+    QMutexLocker lock(&d_sourceLock);
+    if( id == 0 || id > d_sourcePaths.size() )
+        return QString();
+    return d_sourcePaths[id - 1];
 }
@@ -35,19 +35,27 @@ namespace Cedar
 #else
         quint8 d_type; // TokenType
 #endif
-        quint8 d_len;
+        quint16 d_sourceId; // see sourcePath()
         quint32 d_lineNr : RowCol::ROW_BIT_LEN;
         quint32 d_colNr : RowCol::COL_BIT_LEN;
-        QString d_sourcePath;
+        quint32 d_off, d_len; // of the text in the buffer of the lexer
 
         QByteArray d_val;
         const char* d_id; // lower-case internalized version of d_val
         Token(quint16 t = Tok_Invalid, quint32 line = 0, quint16 col = 0, const QByteArray& val = QByteArray()):
-            d_type(t), d_lineNr(line),d_colNr(col),d_val(val),d_len(0),d_id(0){}
+            d_type(t),d_sourceId(0),d_lineNr(line),d_colNr(col),d_off(0),d_len(0),d_val(val),d_id(0){}
         bool isValid() const { return d_type != Tok_Eof && d_type != Tok_Invalid; }
         RowCol toLoc() const { return RowCol(d_lineNr,d_colNr); }
 
+        // the interned lower-case version of ident; thread safe, and equal for equal identifiers
+        // regardless of case
         static const char* toId(const QByteArray& ident);
+        static const char* toId(const char* str, int len);
+        // the paths of the source files are numbered in a global table, so tokens only carry
+        // the number; 0 is no path, and also all paths beyond the 65535th
+        static quint16 toSourceId(const QString& path);
+        static QString sourcePath(quint16 id);
+        QString sourcePath() const { return sourcePath(d_sourceId); }
     };
 }
 
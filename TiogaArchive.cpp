@@ -0,0 +1,646 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "TiogaArchive.h"
+#include <QDir>
+#include <QFile>
+#include <QMap>
+#include <QTemporaryFile>
+#include <limits.h>
+#include <string.h>
+
+// Inflate after RFC 1951, following the structure of zlib's puff.c: canonical Huffman codes are
+// decoded bit by bit from the code counts. Not the fastest possible, but small and it only runs
+// when a member is opened.
+
+struct tarch_Huffman
+{
+    short count[16];  // number of codes of each length
+    short symbol[288]; // symbols ordered by code
+};
+
+struct tarch_Inflater
+{
+    enum { MaxBits = 15, Window = 32768, Chunk = 4 * 1024 * 1024 };
+
+    const uchar* in;
+    qint64 inLen, inPos;
+    quint32 bitBuf;
+    int bitCnt;
+    QByteArray& out;
+    int outPos;
+    qint64 written; // to the sink
+    qint64 limit;   // of written + outPos, or < 0
+    QIODevice* sink;
+    bool ok;
+
+    tarch_Inflater(const uchar* i, qint64 len, QByteArray& o, QIODevice* s, qint64 l):
+        in(i),inLen(len),inPos(0),bitBuf(0),bitCnt(0),out(o),outPos(0),written(0),limit(l),sink(s),ok(true) {}
+
+    int bits(int need)
+    {
+        quint32 val = bitBuf;
+        while (bitCnt < need) {
+            if (inPos >= inLen) {
+                ok = false;
+                return 0;
+            }
+            val |= quint32(in[inPos++]) << bitCnt;
+            bitCnt += 8;
+        }
+        bitBuf = val >> need;
+        bitCnt -= need;
+        return val & ((1u << need) - 1);
+    }
+
+    // make room for n more bytes; with a sink everything but the window is written out
+    bool reserve(int n)
+    {
+        // the sizes claimed by the archive are not trusted, so the output is capped here and
+        // the growth is computed in 64 bits
+        if (limit >= 0 && written + outPos + n > limit)
+            return false;
+        if (outPos + n <= out.size())
+            return true;
+        if (sink && outPos > Window) {
+            const int keep = Window;
+            if (sink->write(out.constData(), outPos - keep) != outPos - keep)
+                return false;
+            written += outPos - keep;
+            ::memmove(out.data(), out.constData() + outPos - keep, keep);
+            outPos = keep;
+            if (outPos + n <= out.size())
+                return true;
+        }
+        qint64 size = qMax(qMax(qint64(out.size()) * 2, qint64(outPos) + n), qint64(sink ? int(Chunk) : 4096));
+        if (limit >= 0 && !sink)
+            size = qMin(size, limit);
+        if (size > INT_MAX)
+            return false;
+        out.resize(int(size));
+        return true;
+    }
+
+    bool finish()
+    {
+        if (sink)
+            return sink->write(out.constData(), outPos) == outPos;
+        out.resize(outPos);
+        return true;
+    }
+
+    bool stored()
+    {
+        bitBuf = 0; // the rest of the current byte is ignored
+        bitCnt = 0;
+        if (inPos + 4 > inLen)
+            return false;
+        const int len = in[inPos] | (in[inPos+1] << 8);
+        if (in[inPos+2] != (~len & 0xff) || in[inPos+3] != ((~len >> 8) & 0xff))
+            return false;
+        inPos += 4;
+        if (inPos + len > inLen || !reserve(len))
+            return false;
+        ::memcpy(out.data() + outPos, in + inPos, len);
+        inPos += len;
+        outPos += len;
+        return true;
+    }
+
+    int decode(const tarch_Huffman& h)
+    {
+        int code = 0;  // bits read so far
+        int first = 0; // first code of the current length
+        int index = 0; // index of the first code of the current length in symbol
+        for (int len = 1; len <= MaxBits; len++) {
+            code |= bits(1);
+            const int count = h.count[len];
+            if (code - count < first)
+                return h.symbol[index + (code - first)];
+            index += count;
+            first += count;
+            first <<= 1;
+            code <<= 1;
+        }
+        return -1; // ran out of codes
+    }
+
+    // returns 0 for a complete code, < 0 if over-subscribed, > 0 if incomplete
+    static int construct(tarch_Huffman& h, const short* length, int n)
+    {
+        short offs[MaxBits + 1];
+        int len, symbol, left;
+
+        for (len = 0; len <= MaxBits; len++)
+            h.count[len] = 0;
+        for (symbol = 0; symbol < n; symbol++)
+            h.count[length[symbol]]++;
+        if (h.count[0] == n)
+            return 0; // no codes, complete but decoding will fail
+        left = 1;
+        for (len = 1; len <= MaxBits; len++) {
+            left <<= 1;
+            left -= h.count[len];
+            if (left < 0)
+                return left;
+        }
+        offs[1] = 0;
+        for (len = 1; len < MaxBits; len++)
+            offs[len + 1] = offs[len] + h.count[len];
+        for (symbol = 0; symbol < n; symbol++)
+            if (length[symbol] != 0)
+                h.symbol[offs[length[symbol]]++] = symbol;
+        return left;
+    }
+
+    bool codes(const tarch_Huffman& lencode, const tarch_Huffman& distcode)
+    {
+        static const short lbase[29] = {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static const short lext[29] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static const short dbase[30] = {
+            1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+            8193, 12289, 16385, 24577};
+        static const short dext[30] = {
+            0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+        for (;;) {
+            int symbol = decode(lencode);
+            if (!ok || symbol < 0)
+                return false;
+            if (symbol < 256) {
+                if (!reserve(1))
+                    return false;
+                out.data()[outPos++] = (char)symbol;
+            } else if (symbol == 256) {
+                return true;
+            } else {
+                symbol -= 257;
+                if (symbol >= 29)
+                    return false;
+                const int len = lbase[symbol] + bits(lext[symbol]);
+                symbol = decode(distcode);
+                if (!ok || symbol < 0 || symbol >= 30)
+                    return false;
+                const int dist = dbase[symbol] + bits(dext[symbol]);
+                if (!ok || dist > outPos || !reserve(len))
+                    return false;
+                char* d = out.data() + outPos;
+                const char* s = d - dist;
+                for (int i = 0; i < len; i++)
+                    d[i] = s[i]; // may overlap
+                outPos += len;
+            }
+        }
+    }
+
+    bool fixed()
+    {
+        // cheap enough to build per block, and no shared state between threads
+        tarch_Huffman lencode, distcode;
+        short lengths[288];
+        int symbol;
+        for (symbol = 0; symbol < 144; symbol++)
+            lengths[symbol] = 8;
+        for (; symbol < 256; symbol++)
+            lengths[symbol] = 9;
+        for (; symbol < 280; symbol++)
+            lengths[symbol] = 7;
+        for (; symbol < 288; symbol++)
+            lengths[symbol] = 8;
+        construct(lencode, lengths, 288);
+        for (symbol = 0; symbol < 30; symbol++)
+            lengths[symbol] = 5;
+        construct(distcode, lengths, 30);
+        return codes(lencode, distcode);
+    }
+
+    bool dynamic()
+    {
+        static const short order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+        short lengths[286 + 30];
+        tarch_Huffman lencode, distcode;
+        int index, err;
+
+        const int nlen = bits(5) + 257;
+        const int ndist = bits(5) + 1;
+        const int ncode = bits(4) + 4;
+        if (!ok || nlen > 286 || ndist > 30)
+            return false;
+        for (index = 0; index < ncode; index++)
+            lengths[order[index]] = bits(3);
+        for (; index < 19; index++)
+            lengths[order[index]] = 0;
+        if (!ok || construct(lencode, lengths, 19) != 0)
+            return false;
+
+        index = 0;
+        while (index < nlen + ndist) {
+            int symbol = decode(lencode);
+            if (!ok || symbol < 0)
+                return false;
+            if (symbol < 16) {
+                lengths[index++] = symbol;
+            } else {
+                int len = 0;
+                if (symbol == 16) {
+                    if (index == 0)
+                        return false;
+                    len = lengths[index - 1];
+                    symbol = 3 + bits(2);
+                } else if (symbol == 17)
+                    symbol = 3 + bits(3);
+                else
+                    symbol = 11 + bits(7);
+                if (!ok || index + symbol > nlen + ndist)
+                    return false;
+                while (symbol--)
+                    lengths[index++] = len;
+            }
+        }
+        if (lengths[256] == 0)
+            return false; // no end of block code
+        err = construct(lencode, lengths, nlen);
+        if (err && (err < 0 || nlen != lencode.count[0] + lencode.count[1]))
+            return false; // only a single length 1 code may be incomplete
+        err = construct(distcode, lengths + nlen, ndist);
+        if (err && (err < 0 || ndist != distcode.count[0] + distcode.count[1]))
+            return false;
+        return codes(lencode, distcode);
+    }
+
+    bool run()
+    {
+        int last;
+        do {
+            last = bits(1);
+            const int type = bits(2);
+            if (!ok)
+                return false;
+            bool res;
+            switch (type) {
+            case 0:
+                res = stored();
+                break;
+            case 1:
+                res = fixed();
+                break;
+            case 2:
+                res = dynamic();
+                break;
+            default:
+                res = false;
+                break;
+            }
+            if (!res || !ok)
+                return false;
+        } while (!last);
+        return finish();
+    }
+};
+
+bool TiogaArchive::inflate(const char* in, qint64 len, QByteArray& out, QIODevice* sink, qint64* used, qint64 limit)
+{
+    tarch_Inflater inf((const uchar*)in, len, out, sink, limit);
+    const bool res = inf.run();
+    if( used )
+        *used = inf.inPos;
+    return res;
+}
+
+static inline quint16 tarch_get16(const uchar* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline quint32 tarch_get32(const uchar* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (quint32(p[3]) << 24);
+}
+
+TiogaArchive::TiogaArchive():d_file(0),d_temp(0),d_data(0),d_size(0)
+{
+
+}
+
+TiogaArchive::~TiogaArchive()
+{
+    close();
+}
+
+bool TiogaArchive::isArchive(const QString& path)
+{
+    const QString p = path.toLower();
+    return p.endsWith(".tar") || p.endsWith(".tar.gz") || p.endsWith(".tgz") || p.endsWith(".zip");
+}
+
+bool TiogaArchive::open(const QString& path)
+{
+    close();
+    d_path = path;
+    const QString p = path.toLower();
+    QString tar = path;
+    if( p.endsWith(".tar.gz") || p.endsWith(".tgz") )
+    {
+        if( !gunzip(path) )
+            return false;
+        tar = d_temp->fileName();
+    }
+    d_file = new QFile(tar);
+    if( !d_file->open(QIODevice::ReadOnly) )
+        return fail(QString("cannot open %1").arg(path));
+    d_size = d_file->size();
+    d_data = d_size > 0 ? d_file->map(0, d_size) : 0;
+    if( d_data == 0 )
+        return fail(QString("cannot map %1").arg(path));
+    const bool res = p.endsWith(".zip") ? readZip() : readTar();
+    if( !res )
+        return false;
+    for( int i = 0; i < d_members.size(); i++ )
+        d_byName.insert(d_members[i].name, i);
+    return true;
+}
+
+void TiogaArchive::close()
+{
+    d_members.clear();
+    d_byName.clear();
+    if( d_file )
+        delete d_file; // also unmaps the file
+    d_file = 0;
+    if( d_temp )
+        delete d_temp;
+    d_temp = 0;
+    d_data = 0;
+    d_size = 0;
+}
+
+bool TiogaArchive::fail(const QString& msg)
+{
+    close();
+    d_error = msg;
+    return false;
+}
+
+bool TiogaArchive::gunzip(const QString& path)
+{
+    // RFC 1952; all members of a multi-member file are concatenated
+    QFile in(path);
+    if( !in.open(QIODevice::ReadOnly) )
+        return fail(QString("cannot open %1").arg(path));
+    const qint64 size = in.size();
+    const uchar* data = size > 0 ? in.map(0, size) : 0;
+    if( data == 0 )
+        return fail(QString("cannot map %1").arg(path));
+    d_temp = new QTemporaryFile();
+    if( !d_temp->open() )
+        return fail("cannot create a temporary file");
+    qint64 pos = 0;
+    while( pos + 18 <= size && data[pos] == 0x1f && data[pos+1] == 0x8b )
+    {
+        if( data[pos+2] != 8 )
+            return fail("unknown gzip compression method");
+        const int flags = data[pos+3];
+        qint64 p = pos + 10;
+        if( flags & 4 ) // FEXTRA
+            p += 2 + tarch_get16(data + p);
+        if( flags & 8 ) // FNAME
+            while( p < size && data[p++] != 0 )
+                ;
+        if( flags & 16 ) // FCOMMENT
+            while( p < size && data[p++] != 0 )
+                ;
+        if( flags & 2 ) // FHCRC
+            p += 2;
+        if( p >= size )
+            return fail("truncated gzip header");
+        QByteArray buf;
+        qint64 used = 0;
+        if( !inflate((const char*)data + p, size - p, buf, d_temp, &used) )
+            return fail(QString("corrupt gzip data in %1").arg(path));
+        pos = p + used + 8; // CRC32 and ISIZE
+    }
+    if( pos == 0 )
+        return fail(QString("%1 is not a gzip file").arg(path));
+    d_temp->flush();
+    return true;
+}
+
+static qint64 tarch_octal(const uchar* p, int len)
+{
+    if( p[0] & 0x80 )
+    {
+        // GNU base-256 for big sizes
+        qint64 v = p[0] & 0x7f;
+        for( int i = 1; i < len; i++ )
+            v = ( v << 8 ) | p[i];
+        return v;
+    }
+    qint64 v = 0;
+    for( int i = 0; i < len && p[i]; i++ )
+    {
+        if( p[i] >= '0' && p[i] <= '7' )
+            v = ( v << 3 ) | ( p[i] - '0' );
+    }
+    return v;
+}
+
+static QString tarch_string(const uchar* p, int len)
+{
+    int n = 0;
+    while( n < len && p[n] )
+        n++;
+    return QString::fromUtf8((const char*)p, n);
+}
+
+static QString tarch_clean(QString name)
+{
+    while( name.startsWith("./") )
+        name = name.mid(2);
+    while( name.startsWith('/') )
+        name = name.mid(1);
+    return name;
+}
+
+bool TiogaArchive::readTar()
+{
+    // POSIX ustar, with GNU long names and pax path records
+    enum { Block = 512 };
+    qint64 pos = 0;
+    QString longName;
+    while( pos + Block <= d_size )
+    {
+        const uchar* h = d_data + pos;
+        if( h[0] == 0 )
+            break; // end of archive
+        const qint64 size = tarch_octal(h + 124, 12);
+        const char type = h[156];
+        const qint64 data = pos + Block;
+        if( size < 0 || data + size > d_size )
+            return fail(QString("truncated tar member at offset %1").arg(pos));
+        if( type == 'L' )
+            longName = tarch_string(d_data + data, size);
+        else if( type == 'x' )
+        {
+            // records "length key=value\n"
+            const QByteArray pax = QByteArray::fromRawData((const char*)d_data + data, size);
+            int i = 0;
+            while( i < pax.size() )
+            {
+                const int sp = pax.indexOf(' ', i);
+                const int len = sp < 0 ? 0 : pax.mid(i, sp - i).toInt();
+                if( len <= 0 )
+                    break;
+                const QByteArray rec = pax.mid(sp + 1, i + len - sp - 2);
+                if( rec.startsWith("path=") )
+                    longName = QString::fromUtf8(rec.mid(5));
+                i += len;
+            }
+        }else if( type == '0' || type == 0 || type == '7' )
+        {
+            Member m;
+            if( !longName.isEmpty() )
+                m.name = longName;
+            else if( ::memcmp(h + 257, "ustar", 5) == 0 && h[345] != 0 )
+                m.name = tarch_string(h + 345, 155) + "/" + tarch_string(h, 100);
+            else
+                m.name = tarch_string(h, 100);
+            m.name = tarch_clean(m.name);
+            m.offset = data;
+            m.size = m.packedSize = size;
+            m.method = 0;
+            if( !m.name.isEmpty() )
+                d_members.append(m);
+            longName.clear();
+        }else
+            longName.clear();
+        pos = data + ( ( size + Block - 1 ) / Block ) * Block;
+    }
+    return true;
+}
+
+bool TiogaArchive::readZip()
+{
+    // find the end of central directory record; it is followed by a comment of up to 64k
+    enum { EocdLen = 22, CentralLen = 46, LocalLen = 30 };
+    qint64 eocd = -1;
+    for( qint64 p = d_size - EocdLen; p >= 0 && p >= d_size - EocdLen - 0xffff; p-- )
+    {
+        if( tarch_get32(d_data + p) == 0x06054b50 )
+        {
+            eocd = p;
+            break;
+        }
+    }
+    if( eocd < 0 )
+        return fail(QString("%1 is not a zip file").arg(d_path));
+    const quint32 count = tarch_get16(d_data + eocd + 10);
+    qint64 p = tarch_get32(d_data + eocd + 16);
+    for( quint32 i = 0; i < count; i++ )
+    {
+        if( p + CentralLen > d_size || tarch_get32(d_data + p) != 0x02014b50 )
+            return fail(QString("corrupt zip central directory in %1").arg(d_path));
+        const uchar* c = d_data + p;
+        const int nameLen = tarch_get16(c + 28);
+        const int extraLen = tarch_get16(c + 30);
+        const int commentLen = tarch_get16(c + 32);
+        if( p + CentralLen + nameLen > d_size )
+            return fail(QString("corrupt zip central directory in %1").arg(d_path));
+        Member m;
+        // bit 11 is set for UTF-8 names, otherwise the names are CP437, which is ASCII in practice
+        m.name = tarch_get16(c + 8) & 0x800 ? QString::fromUtf8((const char*)c + CentralLen, nameLen)
+                                            : QString::fromLatin1((const char*)c + CentralLen, nameLen);
+        m.name = tarch_clean(m.name);
+        m.method = tarch_get16(c + 10);
+        m.packedSize = tarch_get32(c + 20);
+        m.size = tarch_get32(c + 24);
+        m.offset = tarch_get32(c + 42);
+        if( !m.name.isEmpty() && !m.name.endsWith('/') )
+        {
+            if( m.offset + LocalLen > d_size )
+                return fail(QString("corrupt zip member %1").arg(m.name));
+            d_members.append(m);
+        }
+        p += CentralLen + nameLen + extraLen + commentLen;
+    }
+    return true;
+}
+
+int TiogaArchive::find(const QString& name) const
+{
+    return d_byName.value(name, -1);
+}
+
+bool TiogaArchive::read(int i, QByteArray& out) const
+{
+    if( d_data == 0 || i < 0 || i >= d_members.size() )
+        return false;
+    const Member& m = d_members[i];
+    qint64 off = m.offset;
+    if( d_path.toLower().endsWith(".zip") )
+    {
+        // the local header can have another extra field than the central directory
+        const uchar* l = d_data + off;
+        if( tarch_get32(l) != 0x04034b50 )
+            return false;
+        off += 30 + tarch_get16(l + 26) + tarch_get16(l + 28);
+    }
+    if( off + m.packedSize > d_size || m.size > INT_MAX )
+        return false;
+    const char* data = (const char*)d_data + off;
+    if( m.method == 0 )
+    {
+        // the sizes come from the file; only packedSize was checked against it
+        if( m.size != m.packedSize )
+            return false;
+        out = QByteArray(data, m.size);
+        return true;
+    }else if( m.method == 8 )
+    {
+        out.clear();
+        // the size is only a hint for the buffer and an upper bound for the output; inflate
+        // grows the buffer up to it
+        out.resize(qMin(m.size, 4 * m.packedSize + 4096));
+        if( !inflate(data, m.packedSize, out, 0, 0, m.size) )
+            return false;
+        return out.size() == m.size;
+    }else
+        return false;
+}
+
+QStringList TiogaArchive::files(const QStringList& nameFilters) const
+{
+    QStringList res;
+    foreach( const Member& m, d_members )
+    {
+        // QDir doesn't list hidden files and directories by default
+        const QStringList parts = m.name.split('/');
+        bool hidden = false;
+        foreach( const QString& part, parts )
+        {
+            if( part.startsWith('.') )
+                hidden = true;
+        }
+        if( !hidden && QDir::match(nameFilters, parts.last()) )
+            res << m.name;
+    }
+    return res;
+}
@@ -0,0 +1,81 @@
+#ifndef TIOGAARCHIVE_H
+#define TIOGAARCHIVE_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include <QStringList>
+#include <QHash>
+#include <QVector>
+
+class QFile;
+class QIODevice;
+class QTemporaryFile;
+
+// Read-only access to the members of a .tar, .tar.gz/.tgz or .zip file without extracting it.
+// The archive is memory mapped; a .tar.gz is inflated once into a temporary file because gzip
+// has no random access. read() is const and can be called from many threads.
+class TiogaArchive
+{
+public:
+    struct Member
+    {
+        QString name;    // relative path with '/' separators
+        qint64 offset;   // of the data (tar) or of the local header (zip)
+        qint64 size;     // uncompressed
+        qint64 packedSize;
+        quint16 method;  // 0 stored, 8 deflated
+    };
+
+    TiogaArchive();
+    ~TiogaArchive();
+
+    static bool isArchive(const QString& path); // by suffix
+    bool open(const QString& path);
+    void close();
+    bool isOpen() const { return d_data != 0; }
+    const QString& path() const { return d_path; }
+    const QString& error() const { return d_error; }
+
+    int count() const { return d_members.size(); }
+    const Member& member(int i) const { return d_members[i]; }
+    int find(const QString& name) const; // -1 if not found
+    bool read(int i, QByteArray& out) const;
+    // the members whose file name matches one of the filters, without hidden files and
+    // directories, i.e. the files QDir would list in the extracted tree
+    QStringList files(const QStringList& nameFilters) const;
+
+    // raw deflate data as used by zip and gzip; if sink is set, the output is written to it
+    // in chunks instead of collected in out; fails as soon as the output would exceed limit
+    // bytes (if limit >= 0)
+    static bool inflate(const char* in, qint64 len, QByteArray& out, QIODevice* sink = 0, qint64* used = 0,
+                        qint64 limit = -1);
+protected:
+    bool readTar();
+    bool readZip();
+    bool gunzip(const QString& path);
+    bool fail(const QString&);
+private:
+    QString d_path, d_error;
+    QVector<Member> d_members;
+    QHash<QString,int> d_byName;
+    QFile* d_file;
+    QTemporaryFile* d_temp;
+    const uchar* d_data;
+    qint64 d_size;
+};
+
+#endif // TIOGAARCHIVE_H
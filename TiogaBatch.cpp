@@ -0,0 +1,520 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+// Headless decoder of a whole source tree, e.g. for nightly jobs and throughput measurements
+
+#include "TiogaReader.h"
+#include "TiogaArchive.h"
+#include "TiogaCache.h"
+#include "TiogaCorpus.h"
+#include "TiogaIndex.h"
+#include "TiogaStore.h"
+#include "CedarDiff.h"
+#include "CedarLexer.h"
+#include "CedarParser.h"
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QRunnable>
+#include <QScopedPointer>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+struct Batch
+{
+    QStringList files;
+    QAtomicInt next;
+    QMutex lock;
+    TiogaStats stats;
+    QStringList failed;
+    qint64 bytes;
+    int plain;
+    TiogaCache* cache;
+    TiogaIndex* index;
+    bool titles; // only decode the outlines and collect the first heading of each file
+    QMap<QString,QString> titleOf;
+    TiogaStore* store; // if set, identical contents are decoded only once
+    int duplicates, issues;
+    TiogaArchive* archive; // if the root is an archive, the files are its members
+    QList<int> members; // index of each file in the archive
+    TiogaCorpus* corpus; // if set, the decoded texts are added, with paths relative to the root
+    int rootLen;
+    Batch():bytes(0),plain(0),cache(0),index(0),titles(false),store(0),duplicates(0),issues(0),archive(0),
+        corpus(0),rootLen(0){}
+};
+
+// Parses each distinct code content once with the Cedar parser
+class ParsingStore : public TiogaStore
+{
+protected:
+    void parse(const QString& path, Artifact& a)
+    {
+        Cedar::Lexer lex;
+        lex.setStream(a.text, path);
+        lex.setComments(a.spans);
+        lex.setCopyValues(false); // only the number of errors is of interest
+        Cedar::Parser p(&lex);
+        p.RunParser();
+        foreach( const Cedar::Parser::Error& e, p.errors )
+        {
+            Issue i;
+            i.row = e.row;
+            i.col = e.col;
+            i.msg = e.msg;
+            a.issues << i;
+        }
+    }
+};
+
+class Title : public TiogaVisitor
+{
+public:
+    QString d_title;
+    void text(const char* str, int len, bool)
+    {
+        // decodeOutline only reports the text of headings
+        if( d_title.isEmpty() )
+            d_title = TiogaReader::toString(str, len, true).simplified();
+    }
+};
+
+class Worker : public QRunnable
+{
+public:
+    Worker(Batch* b):d_batch(b){}
+    void run()
+    {
+        TiogaReader r;
+        r.setCache(d_batch->cache);
+        TiogaIndex::Collector props; // collected while r decodes, not in a pass of their own
+        if( d_batch->index )
+            r.setVisitor(&props);
+        QStringList failed;
+        qint64 bytes = 0;
+        int plain = 0, duplicates = 0, issues = 0;
+        TiogaStats stats;
+        forever
+        {
+            const int i = d_batch->next.fetchAndAddRelaxed(1);
+            if( i >= d_batch->files.size() )
+                break;
+            const QString& path = d_batch->files[i];
+            props.records.clear();
+
+            // the bytes come from the mapped file or from the archive member
+            QFile in(path);
+            QByteArray buf;
+            const char* data = 0;
+            qint64 size = 0;
+            uchar* mapped = 0;
+            if( d_batch->archive )
+            {
+                if( !d_batch->archive->read(d_batch->members[i], buf) )
+                {
+                    failed << path;
+                    continue;
+                }
+            }else
+            {
+                if( !in.open(QIODevice::ReadOnly) )
+                {
+                    failed << path;
+                    continue;
+                }
+                mapped = in.size() > 0 ? in.map(0, in.size()) : 0;
+                if( mapped == 0 )
+                    buf = in.readAll();
+            }
+            if( mapped )
+            {
+                data = (const char*)mapped;
+                size = in.size();
+            }else
+            {
+                data = buf.constData();
+                size = buf.size();
+            }
+            bytes += size;
+            const bool code = TiogaReader::isCodeFile(path);
+
+            if( d_batch->titles )
+                outline(data, size, path, failed, plain);
+            else if( d_batch->store )
+            {
+                bool shared = false;
+                TiogaStore::Ref a = d_batch->store->get(path, data, size, code, &shared);
+                if( a->ok && a->tioga && d_batch->index )
+                    d_batch->index->add(path, a->properties); // the index refers to paths, not contents
+                if( a->ok && d_batch->corpus && a->tioga && !code )
+                    d_batch->corpus->addRaw(path.mid(d_batch->rootLen), data, size); // paged by the viewer
+                else if( a->ok && d_batch->corpus )
+                    d_batch->corpus->add(path.mid(d_batch->rootLen), a->text, a->spans, a->tioga, code);
+                if( !a->ok )
+                    failed << QString("%1: %2").arg(path).arg(a->error);
+                else if( shared )
+                    duplicates++;
+                else
+                {
+                    if( !a->tioga )
+                        plain++;
+                    stats.merge(a->stats);
+                    issues += a->issues.size();
+                }
+            }else if( !r.read(data, size, path, code) )
+                failed << r.error;
+            else
+            {
+                if( d_batch->corpus && r.tioga && !code )
+                    d_batch->corpus->addRaw(path.mid(d_batch->rootLen), data, size);
+                else if( d_batch->corpus )
+                    d_batch->corpus->add(path.mid(d_batch->rootLen), r.text, r.spans, r.tioga, code);
+                if( !r.tioga )
+                    plain++;
+                else if( d_batch->index )
+                    d_batch->index->add(path, props.records);
+            }
+            if( mapped )
+                in.unmap(mapped);
+        }
+        QMutexLocker lock(&d_batch->lock);
+        d_batch->stats.merge(r.stats);
+        d_batch->stats.merge(stats);
+        d_batch->failed += failed;
+        d_batch->duplicates += duplicates;
+        d_batch->issues += issues;
+        d_batch->bytes += bytes;
+        d_batch->plain += plain;
+    }
+
+    void outline(const char* data, qint64 size, const QString& path, QStringList& failed, int& plain)
+    {
+        Title t;
+        QString error;
+        const bool res = TiogaReader::decodeOutline(data, size, &t, &error);
+        if( !error.isEmpty() )
+            failed << QString("%1: %2").arg(path).arg(error);
+        else if( !res )
+            plain++;
+        else if( !t.d_title.isEmpty() )
+        {
+            QMutexLocker lock(&d_batch->lock);
+            d_batch->titleOf[path] = t.d_title;
+        }
+    }
+private:
+    Batch* d_batch;
+};
+
+static int query(QTextStream& out, const QString& path, const QByteArray& name, const QByteArray& value,
+                 bool hasValue)
+{
+    QElapsedTimer timer;
+    timer.start();
+    TiogaIndex index;
+    if( !index.open(path) )
+    {
+        out << "cannot open index " << path << endl;
+        return -1;
+    }
+    if( name.isEmpty() )
+    {
+        foreach( const QByteArray& n, index.names() )
+            out << n << endl;
+        return 0;
+    }
+    const QList<TiogaIndex::Hit> hits = hasValue ? index.find(name, value) : index.find(name);
+    const qint64 ms = timer.elapsed();
+    foreach( const TiogaIndex::Hit& h, hits )
+        out << h.file << " node " << h.node << ": " << h.value << endl;
+    out << hits.size() << " hits in " << ms << " ms" << endl;
+    return 0;
+}
+
+static int extract(QTextStream& out, const QString& path, const QString& file, int first, int count)
+{
+    TiogaCorpus corpus;
+    if( !corpus.open(path) )
+    {
+        out << corpus.error() << endl;
+        return -1;
+    }
+    if( file.isEmpty() )
+    {
+        foreach( const QString& p, corpus.paths() )
+            out << p << endl;
+        return 0;
+    }
+    if( count > 0 )
+    {
+        out << corpus.lines(file, first, count);
+        return 0;
+    }
+    TiogaCorpus::Entry e;
+    if( !corpus.read(file, e) )
+    {
+        out << file << " is not in " << path << endl;
+        return -1;
+    }
+    if( !e.raw.isEmpty() )
+    {
+        TiogaReader r;
+        if( !r.read(e.raw, file, false) )
+        {
+            out << file << ": " << r.error << endl;
+            return -1;
+        }
+        e.text = r.text;
+    }
+    out << e.text;
+    return 0;
+}
+
+static int diff(QTextStream& out, const QString& pathA, const QString& pathB)
+{
+    TiogaReader a, b;
+    QFile fa(pathA), fb(pathB);
+    if( !fa.open(QIODevice::ReadOnly) || !fb.open(QIODevice::ReadOnly) )
+    {
+        out << "cannot open " << ( fa.isOpen() ? pathB : pathA ) << endl;
+        return -1;
+    }
+    if( !a.read(fa, pathA, true) || !b.read(fb, pathB, true) )
+    {
+        out << ( a.error.isEmpty() ? b.error : a.error ) << endl;
+        return -1;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    Cedar::Diff d;
+    Cedar::Diff::Tokens ta, tb;
+    d.tokenize(a.text, a.spans, ta);
+    d.tokenize(b.text, b.spans, tb);
+    const QList<Cedar::Diff::Hunk> hunks = Cedar::Diff::compare(ta, tb);
+    const qint64 ms = timer.elapsed();
+
+    const QStringList la = a.text.split('\n'), lb = b.text.split('\n');
+    foreach( const Cedar::Diff::Hunk& h, hunks )
+    {
+        out << "@@ -" << h.aLine << "," << h.aLines << " +" << h.bLine << "," << h.bLines << " @@" << endl;
+        for( int i = h.aLine - 1; i < h.aLine - 1 + h.aLines && i < la.size(); i++ )
+            out << "-" << la[i] << endl;
+        for( int i = h.bLine - 1; i < h.bLine - 1 + h.bLines && i < lb.size(); i++ )
+            out << "+" << lb[i] << endl;
+    }
+    out << hunks.size() << " changes, " << ta.ids.size() << " and " << tb.ids.size() << " tokens, "
+        << ms << " ms" << endl;
+    return hunks.isEmpty() ? 0 : 1;
+}
+
+static void collect(const QString& root, QStringList& files)
+{
+    QDirIterator it(root, TiogaReader::nameFilters(), QDir::Files, QDirIterator::Subdirectories);
+    while( it.hasNext() )
+        files << it.next();
+}
+
+static void collect(TiogaArchive* a, Batch& b)
+{
+    // the same paths as in the extracted tree, with the archive in place of the root directory
+    foreach( const QString& name, a->files(TiogaReader::nameFilters()) )
+    {
+        b.files << a->path() + "/" + name;
+        b.members << a->find(name);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+
+    int threads = QThread::idealThreadCount();
+    bool dumpStats = false, titles = false, dedup = false, parse = false;
+    QString root, cacheDir, indexPath, queryPath, corpusPath, extractPath, extractFile, diffA, diffB;
+    int extractFirst = 0, extractCount = 0;
+    QByteArray queryName, queryValue;
+    bool hasValue = false;
+    const QStringList args = a.arguments();
+    for( int i = 1; i < args.size(); i++ )
+    {
+        if( args[i] == "-j" && i + 1 < args.size() )
+            threads = args[++i].toInt();
+        else if( args[i] == "-stats" )
+            dumpStats = true;
+        else if( args[i] == "-titles" )
+            titles = true;
+        else if( args[i] == "-dedup" )
+            dedup = true;
+        else if( args[i] == "-parse" )
+            parse = true;
+        else if( args[i] == "-cache" && i + 1 < args.size() )
+            cacheDir = args[++i];
+        else if( args[i] == "-index" && i + 1 < args.size() )
+            indexPath = args[++i];
+        else if( args[i] == "-corpus" && i + 1 < args.size() )
+            corpusPath = args[++i];
+        else if( args[i] == "-extract" && i + 1 < args.size() )
+        {
+            // -extract corpus [file [first count]]
+            extractPath = args[++i];
+            if( i + 1 < args.size() && !args[i+1].startsWith('-') )
+                extractFile = args[++i];
+            if( i + 2 < args.size() && !args[i+1].startsWith('-') )
+            {
+                extractFirst = args[++i].toInt();
+                extractCount = args[++i].toInt();
+            }
+        }
+        else if( args[i] == "-diff" && i + 2 < args.size() )
+        {
+            diffA = args[++i];
+            diffB = args[++i];
+        }
+        else if( args[i] == "-query" && i + 1 < args.size() )
+        {
+            // -query index [name [value]]
+            queryPath = args[++i];
+            if( i + 1 < args.size() && !args[i+1].startsWith('-') )
+                queryName = args[++i].toUtf8();
+            if( i + 1 < args.size() && !args[i+1].startsWith('-') )
+            {
+                queryValue = args[++i].toLatin1();
+                hasValue = true;
+            }
+        }
+        else if( !args[i].startsWith('-') )
+            root = args[i];
+        else
+        {
+            out << "unknown option " << args[i] << endl;
+            return -1;
+        }
+    }
+    if( !queryPath.isEmpty() )
+        return query(out, queryPath, queryName, queryValue, hasValue);
+    if( !extractPath.isEmpty() )
+        return extract(out, extractPath, extractFile, extractFirst, extractCount);
+    if( !diffA.isEmpty() )
+        return diff(out, diffA, diffB);
+    if( root.isEmpty() || threads < 1 )
+    {
+        out << "usage: TiogaBatch [-j threads] [-stats] [-titles] [-dedup] [-parse] [-cache dir] [-index file] [-corpus file] <root directory or archive>" << endl;
+        out << "       TiogaBatch -query index [property name [value]]" << endl;
+        out << "       TiogaBatch -extract corpus [file [first line count]]" << endl;
+        out << "       TiogaBatch -diff old.mesa new.mesa" << endl;
+        return -1;
+    }
+
+    while( root.size() > 1 && root.endsWith('/') )
+        root.chop(1);
+    Batch b;
+    b.titles = titles;
+    TiogaArchive archive;
+    if( TiogaArchive::isArchive(root) )
+    {
+        if( !archive.open(root) )
+        {
+            out << archive.error() << endl;
+            return -1;
+        }
+        b.archive = &archive;
+        collect(&archive, b);
+    }else
+        collect(root, b.files);
+    QScopedPointer<TiogaCache> cache;
+    if( !cacheDir.isEmpty() )
+    {
+        cache.reset(new TiogaCache(cacheDir));
+        b.cache = cache.data();
+    }
+    QScopedPointer<TiogaStore> store;
+    if( dedup || parse )
+    {
+        store.reset(parse ? new ParsingStore() : new TiogaStore());
+        store->setCache(b.cache);
+        // the text is only needed again for the duplicates added to a corpus
+        store->setKeepText(!corpusPath.isEmpty() && !titles);
+        store->setKeepProperties(!indexPath.isEmpty());
+        b.store = store.data();
+    }
+    QScopedPointer<TiogaIndex> index;
+    if( !indexPath.isEmpty() )
+    {
+        index.reset(new TiogaIndex());
+        b.index = index.data();
+    }
+    TiogaCorpus corpus;
+    if( !corpusPath.isEmpty() && !titles )
+    {
+        if( !corpus.create(corpusPath) )
+        {
+            out << corpus.error() << endl;
+            return -1;
+        }
+        b.corpus = &corpus;
+        b.rootLen = root.length() + 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    for( int i = 0; i < threads; i++ )
+        pool.start(new Worker(&b));
+    pool.waitForDone();
+    const double secs = qMax(timer.elapsed(), qint64(1)) / 1000.0;
+
+    out << "threads: " << threads << endl;
+    out << "files: " << b.files.size() << " (" << b.plain << " not in Tioga format)" << endl;
+    if( store )
+        out << "distinct contents: " << store->contentCount() << " (" << b.duplicates << " duplicates)" << endl;
+    if( parse )
+        out << "parser errors: " << b.issues << endl;
+    out << "bytes: " << b.bytes << endl;
+    out << "seconds: " << secs << endl;
+    out << "files/s: " << b.files.size() / secs << endl;
+    out << "MB/s: " << b.bytes / secs / 1000000.0 << endl;
+    if( index && !index->save(indexPath) )
+        out << "cannot write index " << indexPath << endl;
+    if( b.corpus && !corpus.commit() )
+        out << corpus.error() << endl;
+    out << "failures: " << b.failed.size() << endl;
+    foreach( const QString& path, b.failed )
+        out << "    " << path << endl;
+    if( titles )
+    {
+        out << "titles:" << endl;
+        QMap<QString,QString>::const_iterator t;
+        for( t = b.titleOf.begin(); t != b.titleOf.end(); ++t )
+            out << "    " << t.key() << ": " << t.value() << endl;
+    }
+    if( dumpStats )
+    {
+        out << "formats:" << endl;
+        QMap<QByteArray,int>::const_iterator i;
+        for( i = b.stats.formats.begin(); i != b.stats.formats.end(); ++i )
+            out << "    " << i.key() << " " << i.value() << endl;
+        out << "looks:" << endl;
+        QMap<quint32,int>::const_iterator j;
+        for( j = b.stats.looks.begin(); j != b.stats.looks.end(); ++j )
+            out << "    " << QByteArray::number(j.key(),16) << " " << j.value() << endl;
+    }
+    return b.failed.isEmpty() ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+QT       += core
+QT       -= gui
+
+TARGET = TiogaBatch
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    TiogaBatch.cpp \
+    TiogaReader.cpp \
+    TiogaCache.cpp \
+    TiogaIndex.cpp \
+    TiogaStore.cpp \
+    TiogaArchive.cpp \
+    TiogaCorpus.cpp \
+    CedarLexer.cpp \
+    CedarDiff.cpp \
+    CedarToken.cpp \
+    CedarTokenType.cpp \
+    CedarKeywords.cpp \
+    CedarSynTree.cpp \
+    CedarParser.cpp
+
+HEADERS  += \
+    TiogaReader.h \
+    TiogaCache.h \
+    TiogaIndex.h \
+    TiogaStore.h \
+    TiogaArchive.h \
+    TiogaCorpus.h \
+    CedarLexer.h \
+    CedarDiff.h \
+    CedarParser.h
+
+CONFIG(debug, debug|release) {
+        DEFINES += _DEBUG
+}
@@ -0,0 +1,513 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+// Throughput benchmark and fuzzer of TiogaReader, fed by a generator of synthetic Tioga files
+
+#include "TiogaReader.h"
+#include <QAtomicInt>
+#include <QByteArrayList>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+
+// the reproducible random sequence of a seed, independent of the platform rand()
+struct Random
+{
+    quint32 d_state;
+    Random(quint32 seed):d_state(seed ? seed : 0x9e3779b9) {}
+    quint32 next()
+    {
+        d_state ^= d_state << 13;
+        d_state ^= d_state >> 17;
+        d_state ^= d_state << 5;
+        return d_state;
+    }
+    int below(int n) { return n > 0 ? next() % n : 0; }
+    bool percent(int p) { return below(100) < p; }
+};
+
+struct GenParams
+{
+    int nodes;      // per file
+    int depth;      // max nesting below the root node
+    int runs;       // looks runs per node
+    int props;      // properties per node
+    int comments;   // percentage of nodes with the text in the comment region
+    int textLen;    // average characters per node
+    int commentLen; // average characters per comment node
+    GenParams():nodes(2000),depth(6),runs(2),props(0),comments(10),textLen(60),commentLen(60){}
+};
+
+// Writes the three regions and the trailer in the layout tread_Reader::init checks; format names,
+// looks and property names are interned the same way the reader does, so the short ops are used.
+class Generator
+{
+public:
+    Generator(const GenParams& p, quint32 seed):d_p(p),d_rand(seed),d_budget(0)
+    {
+        d_props << "prefix" << "postfix"; // preloaded by the reader
+    }
+
+    QByteArray generate()
+    {
+        d_budget = d_p.nodes;
+        startNode("root", false);
+        children(1);
+        d_ctrl.append((char)OpEndNode);
+        d_ctrl.append((char)OpEndOfFile);
+
+        QByteArray out = d_text;
+        QByteArray head(6, 0); // comment ID is 0,0
+        putLength(head, 2, d_com.size() + 6);
+        out += head + d_com;
+        head[0] = (char)0x9d;
+        head[1] = (char)0xca;
+        putLength(head, 2, 6 + d_ctrl.size() + 14);
+        out += head + d_ctrl;
+        QByteArray trailer(14, 0);
+        trailer[0] = (char)0x85;
+        trailer[1] = (char)0x97;
+        putLength(trailer, 2, 0);
+        putLength(trailer, 6, d_text.size());
+        putLength(trailer, 10, out.size() + 14);
+        return out + trailer;
+    }
+private:
+    // the opcodes of tioga_ControlOp in TiogaReader.cpp
+    enum { NumFormats = 70, NumLooks = 50,
+           OpEndOfFile = 0, OpStartNode = 1, OpStartNodeFirst = 2, OpTerminalTextNode = 73,
+           OpTerminalTextNodeFirst = 74, OpProp = 149, OpPropShort = 150, OpEndNode = 151,
+           OpRope = 152, OpComment = 153, OpRuns = 154, OpLooks = 155, OpLooksFirst = 156,
+           OpLook1 = 207 };
+
+    void children(int level)
+    {
+        static const char* formats[] = { "head", "head2", "head3", "code", "block", "item",
+                                         "unit", "indent", "example", "note" };
+        while( d_budget > 0 )
+        {
+            const char* f = formats[d_rand.below(sizeof(formats)/sizeof(formats[0]))];
+            const bool inner = level < d_p.depth && d_rand.below(4) == 0;
+            startNode(f, !inner);
+            if( inner )
+            {
+                children(level + 1);
+                d_ctrl.append((char)OpEndNode);
+            }
+            if( level > 1 && d_rand.below(6) == 0 )
+                return;
+        }
+    }
+
+    void startNode(const char* format, bool terminal)
+    {
+        d_budget--;
+        const int i = d_formats.indexOf(format);
+        if( i >= 0 )
+            d_ctrl.append((char)((terminal ? OpTerminalTextNodeFirst : OpStartNodeFirst) + i + 1));
+        else
+        {
+            if( d_formats.size() + 1 < NumFormats )
+                d_formats.append(format);
+            d_ctrl.append((char)(terminal ? OpTerminalTextNode : OpStartNode));
+            putStr(format);
+        }
+        for( int p = 0; p < d_p.props; p++ )
+            putProp();
+        const bool comment = d_rand.percent(d_p.comments);
+        const int len = qMax(1, d_rand.below(2 * (comment ? d_p.commentLen : d_p.textLen)));
+        QByteArray& region = comment ? d_com : d_text;
+        putText(region, len);
+        d_ctrl.append((char)(comment ? OpComment : OpRope));
+        putInt(len);
+        if( d_p.runs > 0 && !comment )
+            putRuns(len);
+    }
+
+    void putText(QByteArray& region, int len)
+    {
+        static const char* words[] = { "PROC", "RETURNS", "BEGIN", "END", "IF", "THEN", "ELSE",
+                                       "Rope.ROPE", "INT", "node", "looks", "_", "\xac", "\r" };
+        const int start = region.size();
+        while( region.size() - start < len )
+        {
+            region.append(words[d_rand.below(sizeof(words)/sizeof(words[0]))]);
+            region.append(' ');
+        }
+        region.resize(start + len);
+        region.append('\r'); // not included in the rope length
+    }
+
+    void putRuns(int len)
+    {
+        const int n = qMin(d_p.runs, len);
+        d_ctrl.append((char)OpRuns);
+        putInt(n);
+        int pos = 0;
+        for( int i = 0; i < n; i++ )
+        {
+            // leave at least one character for each of the remaining runs
+            const int rl = i == n - 1 ? len - pos :
+                                        qMax(1, qMin(d_rand.below(2 * len / n), len - pos - (n - 1 - i)));
+            quint32 l = 0;
+            if( d_rand.below(3) != 0 )
+                l = 1u << (31 - d_rand.below(26)); // a single look char, e.g. 'b'
+            if( d_rand.below(4) == 0 )
+                l |= 1u << (31 - d_rand.below(26));
+            const int j = l ? d_looks.indexOf(l) : -1;
+            if( l == 0 )
+                d_ctrl.append((char)OpLooksFirst);
+            else if( j >= 0 )
+                d_ctrl.append((char)(OpLooksFirst + j + 1));
+            else
+            {
+                if( d_looks.size() + 1 < NumLooks )
+                    d_looks.append(l);
+                if( d_rand.below(2) == 0 )
+                {
+                    d_ctrl.append((char)OpLooks);
+                    d_ctrl.append((char)(l >> 24));
+                    d_ctrl.append((char)(l >> 16));
+                    d_ctrl.append((char)(l >> 8));
+                    d_ctrl.append((char)l);
+                }else
+                {
+                    QByteArray chars;
+                    for( int c = 0; c < 32; c++ )
+                        if( l & ( 1u << (31 - c) ) )
+                            chars.append('a' + c);
+                    d_ctrl.append((char)(OpLook1 + chars.size() - 1));
+                    d_ctrl.append(chars);
+                }
+            }
+            putInt(rl);
+            pos += rl;
+        }
+    }
+
+    void putProp()
+    {
+        static const char* names[] = { "prefix", "postfix", "Comment", "Mark", "Artwork" };
+        const QByteArray name = names[d_rand.below(sizeof(names)/sizeof(names[0]))];
+        const int i = d_props.indexOf(name);
+        if( i >= 0 )
+        {
+            d_ctrl.append((char)OpPropShort);
+            d_ctrl.append((char)(i + 1));
+        }else
+        {
+            d_props.append(name);
+            d_ctrl.append((char)OpProp);
+            putStr(name);
+        }
+        const QByteArray value = "(" + QByteArray::number(d_rand.next()) + ") bold";
+        putInt(value.size());
+        d_ctrl.append(value);
+    }
+
+    void putStr(const QByteArray& str)
+    {
+        d_ctrl.append((char)str.size());
+        d_ctrl.append(str);
+    }
+
+    void putInt(quint32 v)
+    {
+        while( v >= 0x80 )
+        {
+            d_ctrl.append((char)(0x80 | (v & 0x7f)));
+            v >>= 7;
+        }
+        d_ctrl.append((char)v);
+    }
+
+    static void putLength(QByteArray& buf, int off, quint32 v)
+    {
+        // the byte order of tread_Reader::GetLength
+        buf[off] = (char)(v >> 8);
+        buf[off+1] = (char)v;
+        buf[off+2] = (char)(v >> 24);
+        buf[off+3] = (char)(v >> 16);
+    }
+
+    GenParams d_p;
+    Random d_rand;
+    int d_budget;
+    QByteArray d_text, d_com, d_ctrl;
+    QByteArrayList d_formats, d_props;
+    QList<quint32> d_looks;
+};
+
+class Counter : public TiogaVisitor
+{
+public:
+    qint64 d_nodes;
+    Counter():d_nodes(0){}
+    void startNode(const QByteArray&) { d_nodes++; }
+    void endNode() {}
+    void text(const char*, int, bool) {}
+};
+
+static QAtomicInt s_messages;
+
+static void countMessage(QtMsgType, const QMessageLogContext&, const QString&)
+{
+    s_messages.fetchAndAddRelaxed(1); // the decoder reports illegal ops etc. via qCritical
+}
+
+static void bench(QTextStream& out, const QList<QByteArray>& corpus, qint64 bytes, qint64 nodes, int iterations)
+{
+    const char* names[] = { "decode", "code", "html" };
+    for( int mode = 0; mode < 3; mode++ )
+    {
+        TiogaReader r;
+        QElapsedTimer timer;
+        timer.start();
+        for( int n = 0; n < iterations; n++ )
+        {
+            for( int i = 0; i < corpus.size(); i++ )
+            {
+                if( mode == 0 )
+                {
+                    Counter c;
+                    TiogaReader::decode(corpus[i].constData(), corpus[i].size(), &c);
+                }else
+                    r.read(corpus[i], QString(), mode == 1);
+            }
+        }
+        const double secs = qMax(timer.nsecsElapsed(), qint64(1)) / 1e9;
+        out << names[mode] << ": " << secs << " s, "
+            << bytes * iterations / secs / 1000000.0 << " MB/s, "
+            << nodes * iterations / secs << " nodes/s" << endl;
+    }
+}
+
+static void mutate(QByteArray& buf, Random& rand, int count)
+{
+    // mostly hit the control region, which sits before the 14 byte trailer;
+    // sometimes anything, including the region lengths
+    const int len = buf.size();
+    for( int i = 0; i < count; i++ )
+    {
+        int off = rand.percent(80) ? len - 14 - 1 - rand.below(qMin(len - 14, 256)) : rand.below(len);
+        if( off < 0 )
+            off = 0;
+        switch( rand.below(4) )
+        {
+        case 0:
+            buf[off] = buf[off] ^ (char)(1 << rand.below(8));
+            break;
+        case 1:
+            buf[off] = (char)rand.below(256);
+            break;
+        case 2:
+            buf[off] = (char)0xff; // a varint continuation
+            break;
+        case 3:
+            if( off + 1 < len )
+                buf[off+1] = buf[off]; // repeat an op
+            break;
+        }
+    }
+}
+
+// decodes one case in a thread of its own, so a hang of the decoder can be detected
+class FuzzCase : public QThread
+{
+public:
+    QByteArray d_buf;
+    QString d_name;
+    bool d_outline, d_ok, d_tioga;
+    qint64 d_ns;
+    FuzzCase():d_outline(false),d_ok(false),d_tioga(false),d_ns(0){}
+protected:
+    void run()
+    {
+        TiogaReader reader;
+        QElapsedTimer timer;
+        timer.start();
+        d_ok = reader.read(d_buf, d_name, d_outline);
+        d_ns = timer.nsecsElapsed();
+        d_tioga = reader.tioga;
+    }
+};
+
+static int fuzz(QTextStream& out, const GenParams& p, quint32 seed, int cases, const QString& caseFile, int timeout)
+{
+    enum { MaxHangs = 8 }; // each hung thread keeps a core busy
+    qInstallMessageHandler(countMessage);
+    Random rand(seed);
+    int rejected = 0, errors = 0, decoded = 0, hangs = 0;
+    qint64 slowest = 0;
+    quint32 slowestSeed = 0;
+    double slowestRate = 0;
+    int i = 0;
+    for( ; i < cases && hangs < MaxHangs; i++ )
+    {
+        const quint32 s = rand.next();
+        GenParams q = p;
+        Random r(s);
+        q.nodes = 1 + r.below(p.nodes);
+        QByteArray buf = Generator(q, s).generate();
+        mutate(buf, r, 1 + r.below(8));
+        if( !caseFile.isEmpty() )
+        {
+            // if the decoder crashes, the input is left behind
+            QFile f(caseFile);
+            if( f.open(QIODevice::WriteOnly) )
+                f.write(buf);
+        }
+        FuzzCase* c = new FuzzCase();
+        c->d_buf = buf;
+        c->d_name = QString::number(s);
+        c->d_outline = r.below(2);
+        c->start();
+        if( !c->wait(timeout) )
+        {
+            // a thread can't be stopped safely; it is left running and the run goes on
+            out << "hang: case seed " << s << " still running after " << timeout << " ms" << endl;
+            hangs++;
+            continue;
+        }
+        const bool ok = c->d_ok;
+        const bool tioga = c->d_tioga;
+        const qint64 ns = c->d_ns;
+        delete c;
+        if( !ok )
+            errors++;
+        else if( !tioga )
+            rejected++;
+        else
+            decoded++;
+        const double rate = double(ns) / buf.size();
+        if( rate > slowestRate )
+        {
+            slowestRate = rate;
+            slowest = ns;
+            slowestSeed = s;
+        }
+    }
+    if( hangs == 0 )
+        qInstallMessageHandler(0); // else a hung decoder may still be reporting
+    if( i < cases )
+        out << "stopped after " << hangs << " hangs" << endl;
+    out << "cases: " << i << endl;
+    out << "decoded: " << decoded << endl;
+    out << "rejected as not Tioga: " << rejected << endl;
+    out << "corrupt: " << errors << endl;
+    out << "hangs: " << hangs << endl;
+    out << "decoder messages: " << s_messages.load() << endl;
+    out << "slowest: case seed " << slowestSeed << ", " << slowest / 1000 << " us, "
+        << slowestRate << " ns/byte" << endl;
+    return hangs == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+
+    GenParams p;
+    int files = 100, iterations = 5, cases = 0, timeout = 10000;
+    quint32 seed = 1;
+    QString writeTo, caseFile;
+    const QStringList args = a.arguments();
+    for( int i = 1; i < args.size(); i++ )
+    {
+        const bool hasArg = i + 1 < args.size();
+        if( args[i] == "-files" && hasArg )
+            files = args[++i].toInt();
+        else if( args[i] == "-nodes" && hasArg )
+            p.nodes = args[++i].toInt();
+        else if( args[i] == "-depth" && hasArg )
+            p.depth = args[++i].toInt();
+        else if( args[i] == "-runs" && hasArg )
+            p.runs = args[++i].toInt();
+        else if( args[i] == "-props" && hasArg )
+            p.props = args[++i].toInt();
+        else if( args[i] == "-comments" && hasArg )
+            p.comments = args[++i].toInt();
+        else if( args[i] == "-textlen" && hasArg )
+            p.textLen = args[++i].toInt();
+        else if( args[i] == "-commentlen" && hasArg )
+            p.commentLen = args[++i].toInt();
+        else if( args[i] == "-iter" && hasArg )
+            iterations = args[++i].toInt();
+        else if( args[i] == "-seed" && hasArg )
+            seed = args[++i].toUInt();
+        else if( args[i] == "-write" && hasArg )
+            writeTo = args[++i];
+        else if( args[i] == "-fuzz" && hasArg )
+            cases = args[++i].toInt();
+        else if( args[i] == "-case" && hasArg )
+            caseFile = args[++i];
+        else if( args[i] == "-timeout" && hasArg )
+            timeout = args[++i].toInt();
+        else
+        {
+            out << "usage: TiogaBench [-files n] [-nodes n] [-depth n] [-runs n] [-props n] [-comments percent]" << endl;
+            out << "                  [-textlen n] [-commentlen n] [-iter n] [-seed n] [-write file]" << endl;
+            out << "                  [-fuzz cases [-case file] [-timeout ms]]" << endl;
+            return -1;
+        }
+    }
+    if( files < 1 || p.nodes < 1 || iterations < 1 )
+    {
+        out << "files, nodes and iterations must be positive" << endl;
+        return -1;
+    }
+
+    if( cases > 0 )
+        return fuzz(out, p, seed, cases, caseFile, timeout);
+
+    QList<QByteArray> corpus;
+    qint64 bytes = 0;
+    Random rand(seed);
+    for( int i = 0; i < files; i++ )
+    {
+        corpus << Generator(p, rand.next()).generate();
+        bytes += corpus.last().size();
+    }
+    if( !writeTo.isEmpty() )
+    {
+        QFile f(writeTo);
+        if( !f.open(QIODevice::WriteOnly) )
+        {
+            out << "cannot write " << writeTo << endl;
+            return -1;
+        }
+        f.write(corpus.first());
+    }
+    Counter c;
+    for( int i = 0; i < corpus.size(); i++ )
+    {
+        if( !TiogaReader::decode(corpus[i].constData(), corpus[i].size(), &c) )
+        {
+            out << "generated file not accepted by the reader" << endl;
+            return 1;
+        }
+    }
+
+    out << "files: " << files << endl;
+    out << "bytes: " << bytes << endl;
+    out << "nodes: " << c.d_nodes << endl;
+    out << "iterations: " << iterations << endl;
+    bench(out, corpus, bytes, c.d_nodes, iterations);
+    return 0;
+}
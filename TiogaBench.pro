@@ -0,0 +1,22 @@
+QT       += core
+QT       -= gui
+
+TARGET = TiogaBench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    TiogaBench.cpp \
+    TiogaReader.cpp \
+    TiogaCache.cpp
+
+HEADERS  += \
+    TiogaReader.h \
+    TiogaCache.h
+
+CONFIG(debug, debug|release) {
+        DEFINES += _DEBUG
+}
@@ -0,0 +1,230 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "TiogaCache.h"
+#include "TiogaReader.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <string.h>
+
+// Entry layout, all numbers are quint32 in host byte order so the file can be used mapped:
+//   header: magic, flags, number of UTF-16 text units, number of spans, number of formats, number of looks
+//   text: UTF-16, padded to 4 bytes
+//   spans: position, length, looks, flags (TiogaSpan::Comment for comment lines)
+//   formats: count, length of name, name bytes padded to 4 bytes
+//   looks: looks vector, count
+
+static const char s_magic[] = "TGC4";
+enum { HeaderLen = 6 * 4, IsTioga = 1 };
+
+static inline int pad4( int n )
+{
+    return ( n + 3 ) & ~3;
+}
+
+TiogaCache::TiogaCache(const QString& dir, qint64 maxSize):d_dir(dir),d_maxSize(maxSize),d_used(-1),d_clock(0)
+{
+    if( d_dir.isEmpty() )
+        d_dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/TiogaCache";
+    QDir().mkpath(d_dir);
+}
+
+void TiogaCache::setMaxSize(qint64 s)
+{
+    QMutexLocker lock(&d_lock);
+    d_maxSize = s;
+    evict();
+}
+
+QByteArray TiogaCache::key(const char* data, int len, bool code)
+{
+    QCryptographicHash h(QCryptographicHash::Sha1);
+    h.addData(data,len);
+    return h.result().toHex() + ( code ? ".c" : ".h" );
+}
+
+bool TiogaCache::lookup(const QByteArray& key, QString& text, bool& tioga, QVector<TiogaSpan>* spans,
+                        TiogaStats* stats) const
+{
+    QFile in(d_dir + "/" + key);
+    if( !in.open(QIODevice::ReadOnly) )
+        return false;
+    const qint64 size = in.size();
+    if( size < HeaderLen )
+        return false;
+    const uchar* data = in.map(0,size);
+    if( data == 0 )
+        return false;
+    const quint32* h = (const quint32*)data;
+    if( ::memcmp(data, s_magic, 4) != 0 )
+        return false;
+    const quint32 textLen = h[2];
+    const quint32 nSpans = h[3];
+    const quint32 nFormats = h[4];
+    const quint32 nLooks = h[5];
+    // the counts come from the file, so the sizes are computed in 64 bits and checked before use
+    const qint64 spansOff = HeaderLen + ( ( qint64(textLen) * 2 + 3 ) & ~qint64(3) );
+    qint64 off = spansOff + qint64(nSpans) * sizeof(TiogaSpan);
+    if( off > size )
+        return false;
+    // the stats are only merged into *stats if the whole entry is valid
+    TiogaStats local;
+    if( stats )
+    {
+        for( quint32 i = 0; i < nFormats; i++ )
+        {
+            if( off + 8 > size )
+                return false;
+            const quint32* f = (const quint32*)(data + off);
+            if( off + 8 + f[1] > size )
+                return false;
+            local.formats[QByteArray((const char*)data + off + 8, f[1])] += f[0];
+            off += 8 + ( ( qint64(f[1]) + 3 ) & ~qint64(3) );
+        }
+        if( off + qint64(nLooks) * 8 > size )
+            return false;
+        const quint32* l = (const quint32*)(data + off);
+        for( quint32 i = 0; i < nLooks; i++ )
+            local.looks[l[2*i]] += l[2*i+1];
+    }
+    tioga = h[1] & IsTioga;
+    text = QString((const QChar*)(data + HeaderLen), textLen);
+    if( spans )
+    {
+        spans->resize(nSpans);
+        ::memcpy(spans->data(), data + spansOff, nSpans * sizeof(TiogaSpan));
+    }
+    if( stats )
+        stats->merge(local);
+    // lookup doesn't change the file, so the access order is tracked here for evict()
+    QMutexLocker lock(&d_lock);
+    d_lastUse[QString::fromLatin1(key)] = ++d_clock;
+    return true;
+}
+
+void TiogaCache::insert(const QByteArray& key, const QString& text, bool tioga, const QVector<TiogaSpan>& spans,
+                        const TiogaStats& stats)
+{
+    QByteArray buf;
+    buf.reserve(HeaderLen + pad4(text.size() * 2) + spans.size() * sizeof(TiogaSpan) +
+                stats.formats.size() * 24 + stats.looks.size() * 8);
+    quint32 h[6];
+    ::memcpy(h, s_magic, 4);
+    h[1] = tioga ? IsTioga : 0;
+    h[2] = text.size();
+    h[3] = spans.size();
+    h[4] = stats.formats.size();
+    h[5] = stats.looks.size();
+    buf.append((const char*)h, HeaderLen);
+    buf.append((const char*)text.constData(), text.size() * 2);
+    buf.append(QByteArray(pad4(buf.size()) - buf.size(), 0));
+    buf.append((const char*)spans.constData(), spans.size() * sizeof(TiogaSpan));
+    QMap<QByteArray,int>::const_iterator i;
+    for( i = stats.formats.begin(); i != stats.formats.end(); ++i )
+    {
+        quint32 f[2];
+        f[0] = i.value();
+        f[1] = i.key().size();
+        buf.append((const char*)f, 8);
+        buf.append(i.key());
+        buf.append(QByteArray(pad4(buf.size()) - buf.size(), 0));
+    }
+    QMap<quint32,int>::const_iterator j;
+    for( j = stats.looks.begin(); j != stats.looks.end(); ++j )
+    {
+        quint32 l[2];
+        l[0] = j.key();
+        l[1] = j.value();
+        buf.append((const char*)l, 8);
+    }
+
+    // QSaveFile makes sure concurrent readers never see a partial entry
+    QSaveFile out(d_dir + "/" + key);
+    if( !out.open(QIODevice::WriteOnly) )
+        return;
+    out.write(buf);
+    if( !out.commit() )
+        return;
+
+    QMutexLocker lock(&d_lock);
+    const QString name = QString::fromLatin1(key);
+    d_lastUse[name] = ++d_clock;
+    if( d_used >= 0 )
+    {
+        // another worker may have written the same content before, QSaveFile replaced it
+        d_used += buf.size() - d_sizes.value(name);
+        d_sizes[name] = buf.size();
+    }
+    evict();
+}
+
+void TiogaCache::clear()
+{
+    QMutexLocker lock(&d_lock);
+    QDir dir(d_dir);
+    foreach( const QString& f, dir.entryList(QDir::Files) )
+        dir.remove(f);
+    d_used = 0;
+    d_sizes.clear();
+    d_lastUse.clear();
+}
+
+void TiogaCache::evict()
+{
+    QDir dir(d_dir);
+    QFileInfoList files;
+    if( d_used < 0 )
+    {
+        files = dir.entryInfoList(QDir::Files, QDir::Time | QDir::Reversed);
+        d_used = 0;
+        foreach( const QFileInfo& f, files )
+        {
+            d_used += f.size();
+            d_sizes[f.fileName()] = f.size();
+        }
+    }
+    if( d_used <= d_maxSize )
+        return;
+    if( files.isEmpty() )
+        files = dir.entryInfoList(QDir::Files, QDir::Time | QDir::Reversed);
+    // the entries not used by this process by age, then the used ones least recently used first
+    QFileInfoList order;
+    QMap<quint64,QFileInfo> used;
+    foreach( const QFileInfo& f, files )
+    {
+        QHash<QString,quint64>::const_iterator i = d_lastUse.find(f.fileName());
+        if( i == d_lastUse.end() )
+            order.append(f);
+        else
+            used.insert(i.value(), f);
+    }
+    order += used.values();
+    // shrink a bit below the limit so we don't have to evict on every insert
+    const qint64 target = d_maxSize - d_maxSize / 10;
+    foreach( const QFileInfo& f, order )
+    {
+        if( d_used <= target )
+            break;
+        if( dir.remove(f.fileName()) )
+        {
+            d_used -= d_sizes.take(f.fileName()); // as counted, the file may have been replaced
+            d_lastUse.remove(f.fileName());
+        }
+    }
+}
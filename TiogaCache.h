@@ -0,0 +1,58 @@
+#ifndef TIOGACACHE_H
+#define TIOGACACHE_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include <QHash>
+#include <QString>
+#include <QMutex>
+#include <QVector>
+
+struct TiogaStats;
+struct TiogaSpan;
+
+// On-disk cache of decoded files; an entry is keyed by the hash of the raw bytes and the output
+// mode. When the cache grows beyond its size limit the least recently used entries are removed
+// first; entries this process hasn't used count by their modification time and go before the others.
+class TiogaCache
+{
+public:
+    explicit TiogaCache(const QString& dir = QString(), qint64 maxSize = 256 * 1024 * 1024);
+
+    const QString& dir() const { return d_dir; }
+    void setMaxSize(qint64);
+    qint64 maxSize() const { return d_maxSize; }
+
+    static QByteArray key(const char* data, int len, bool code);
+    bool lookup(const QByteArray& key, QString& text, bool& tioga, QVector<TiogaSpan>* spans = 0,
+                TiogaStats* stats = 0) const;
+    void insert(const QByteArray& key, const QString& text, bool tioga, const QVector<TiogaSpan>& spans,
+                const TiogaStats& stats);
+    void clear();
+protected:
+    void evict();
+private:
+    QString d_dir;
+    qint64 d_maxSize;
+    qint64 d_used; // -1 if not yet known
+    QHash<QString,qint64> d_sizes; // file name -> size of the entries counted in d_used
+    mutable QHash<QString,quint64> d_lastUse; // file name -> d_clock at the last insert or hit
+    mutable quint64 d_clock;
+    mutable QMutex d_lock;
+};
+
+#endif // TIOGACACHE_H
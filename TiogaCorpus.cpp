@@ -0,0 +1,386 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "TiogaCorpus.h"
+#include <QFile>
+#include <algorithm>
+#include <string.h>
+
+// File layout, all numbers in host byte order so the file can be used mapped:
+//   header: magic, block size, number of blocks, number of files, number of spans (quint32),
+//           offset of the tables (quint64)
+//   blocks: qCompress output of block size UTF-8 bytes each (the last one shorter)
+//   tables, each padded to 8 bytes:
+//     block offsets (quint64), the end of the last block last
+//     files: offset in the concatenation (quint64), length, first span, number of spans, flags,
+//            offset and length of the path in the pool (quint32); sorted by path; with IsRaw the
+//            bytes are the original Tioga file instead of UTF-8 text
+//     spans: TiogaSpan
+//     pool: UTF-8 paths
+// Spans refer to UTF-16 positions of the text, as produced by TiogaReader.
+
+static const char s_magic[] = "TGZ2";
+enum { HeaderLen = 5 * 4 + 4 + 8, IsTioga = 1, IsCode = 2, IsRaw = 4 };
+
+static inline qint64 pad8( qint64 n )
+{
+    return ( n + 7 ) & ~7;
+}
+
+struct tcorp_File
+{
+    quint64 off;
+    quint32 len, firstSpan, spanCount, flags, pathOff, pathLen, pad;
+};
+
+TiogaCorpus::TiogaCorpus():d_out(0),d_rawOff(0),d_blockSize(DefaultBlockSize),
+    d_in(0),d_data(0),d_size(0),d_cachedBlock(~0u)
+{
+
+}
+
+TiogaCorpus::~TiogaCorpus()
+{
+    close();
+    delete d_out;
+}
+
+bool TiogaCorpus::isCorpus(const QString& path)
+{
+    return path.endsWith(".tcorpus");
+}
+
+bool TiogaCorpus::fail(const QString& msg)
+{
+    d_error = msg;
+    return false;
+}
+
+bool TiogaCorpus::create(const QString& path, int blockSize)
+{
+    delete d_out;
+    d_out = new QFile(path);
+    if( !d_out->open(QIODevice::WriteOnly) )
+        return fail(QString("cannot write %1").arg(path));
+    d_blockSize = blockSize;
+    d_raw.clear();
+    d_raw.reserve(blockSize);
+    d_rawOff = 0;
+    d_blocks.clear();
+    d_files.clear();
+    d_spans.clear();
+    // the header is written again by commit() when the numbers are known
+    d_out->write(QByteArray(HeaderLen, 0));
+    return true;
+}
+
+bool TiogaCorpus::flushBlock()
+{
+    d_blocks.append(d_out->pos());
+    const QByteArray packed = qCompress(d_raw);
+    if( d_out->write(packed) != packed.size() )
+        return fail("cannot write the corpus");
+    d_rawOff += d_raw.size();
+    d_raw.clear();
+    return true;
+}
+
+void TiogaCorpus::add(const QString& path, const QString& text, const QVector<TiogaSpan>& spans, bool tioga, bool code)
+{
+    const QByteArray utf8 = text.toUtf8();
+    append(path, utf8.constData(), utf8.size(), spans, ( tioga ? IsTioga : 0 ) | ( code ? IsCode : 0 ));
+}
+
+void TiogaCorpus::addRaw(const QString& path, const char* data, int len)
+{
+    append(path, data, len, QVector<TiogaSpan>(), IsTioga | IsRaw);
+}
+
+void TiogaCorpus::append(const QString& path, const char* data, int len, const QVector<TiogaSpan>& spans, quint32 flags)
+{
+    QMutexLocker lock(&d_lock);
+    if( d_out == 0 )
+        return;
+    FileRec f;
+    f.path = path.toUtf8();
+    f.off = d_rawOff + d_raw.size();
+    f.len = len;
+    f.firstSpan = d_spans.size();
+    f.spanCount = spans.size();
+    f.flags = flags;
+    d_files.append(f);
+    d_spans += spans;
+    // the text is cut at exact block boundaries, so block i starts at i * blockSize
+    int pos = 0;
+    while( pos < len )
+    {
+        const int n = qMin(len - pos, d_blockSize - d_raw.size());
+        d_raw.append(data + pos, n);
+        pos += n;
+        if( d_raw.size() == d_blockSize )
+            flushBlock();
+    }
+}
+
+static bool tcorp_lessPath( const QPair<QByteArray,int>& a, const QPair<QByteArray,int>& b )
+{
+    return a.first < b.first;
+}
+
+bool TiogaCorpus::commit()
+{
+    QMutexLocker lock(&d_lock);
+    if( d_out == 0 )
+        return false;
+    if( !d_raw.isEmpty() && !flushBlock() )
+        return false;
+    d_out->write(QByteArray(pad8(d_out->pos()) - d_out->pos(), 0));
+    const quint64 tables = d_out->pos();
+    QByteArray buf;
+    for( int i = 0; i < d_blocks.size(); i++ )
+        buf.append((const char*)&d_blocks[i], 8);
+    buf.append((const char*)&tables, 8);
+
+    QList< QPair<QByteArray,int> > order;
+    for( int i = 0; i < d_files.size(); i++ )
+        order << qMakePair(d_files[i].path, i);
+    std::sort(order.begin(), order.end(), tcorp_lessPath);
+    QByteArray pool;
+    for( int i = 0; i < order.size(); i++ )
+    {
+        const FileRec& r = d_files[order[i].second];
+        tcorp_File f;
+        f.off = r.off;
+        f.len = r.len;
+        f.firstSpan = r.firstSpan;
+        f.spanCount = r.spanCount;
+        f.flags = r.flags;
+        f.pathOff = pool.size();
+        f.pathLen = r.path.size();
+        f.pad = 0;
+        pool.append(r.path);
+        buf.append((const char*)&f, sizeof(f));
+    }
+    buf.append((const char*)d_spans.constData(), d_spans.size() * sizeof(TiogaSpan));
+    buf.append(QByteArray(pad8(buf.size()) - buf.size(), 0));
+    buf.append(pool);
+    d_out->write(buf);
+
+    QByteArray header(s_magic, 4);
+    const quint32 h[4] = { quint32(d_blockSize), quint32(d_blocks.size()), quint32(d_files.size()),
+                           quint32(d_spans.size()) };
+    header.append((const char*)h, sizeof(h));
+    header.append(QByteArray(4, 0));
+    header.append((const char*)&tables, 8);
+    d_out->seek(0);
+    d_out->write(header);
+    const bool ok = d_out->error() == QFile::NoError;
+    delete d_out;
+    d_out = 0;
+    d_files.clear();
+    d_spans.clear();
+    d_blocks.clear();
+    return ok ? true : fail("cannot write the corpus");
+}
+
+bool TiogaCorpus::open(const QString& path)
+{
+    close();
+    d_in = new QFile(path);
+    if( !d_in->open(QIODevice::ReadOnly) )
+        return fail(QString("cannot open %1").arg(path));
+    d_size = d_in->size();
+    const uchar* data = d_size >= HeaderLen ? d_in->map(0, d_size) : 0;
+    if( data == 0 || ::memcmp(data, s_magic, 4) != 0 )
+    {
+        close();
+        return fail(QString("%1 is not a corpus file").arg(path));
+    }
+    const quint32* h = (const quint32*)data;
+    const quint64 tables = *(const quint64*)(data + 24);
+    const quint64 spans = tables + ( quint64(h[2]) + 1 ) * 8 + quint64(h[3]) * sizeof(tcorp_File);
+    const quint64 pool = pad8(spans + quint64(h[4]) * sizeof(TiogaSpan));
+    if( tables > quint64(d_size) || ( tables & 7 ) || h[1] == 0 || pool > quint64(d_size) )
+    {
+        close();
+        return fail(QString("%1 is truncated").arg(path));
+    }
+    // the records are checked once here, so read() and lines() can trust them
+    const tcorp_File* f = (const tcorp_File*)(data + tables + ( quint64(h[2]) + 1 ) * 8);
+    const quint64 rawSize = quint64(h[1]) * h[2];
+    for( quint32 i = 0; i < h[3]; i++ )
+    {
+        if( f[i].off > rawSize || f[i].len > rawSize - f[i].off || quint64(f[i].firstSpan) + f[i].spanCount > h[4] ||
+                pool + f[i].pathOff + f[i].pathLen > quint64(d_size) )
+        {
+            close();
+            return fail(QString("%1 is corrupt").arg(path));
+        }
+    }
+    d_data = data;
+    return true;
+}
+
+void TiogaCorpus::close()
+{
+    if( d_in )
+        delete d_in; // also unmaps the file
+    d_in = 0;
+    d_data = 0;
+    d_size = 0;
+    QMutexLocker lock(&d_cacheLock);
+    d_cachedBlock = ~0u;
+    d_cached.clear();
+}
+
+// the sections of the mapped file
+#define tcorp_Header ((const quint32*)d_data)
+#define tcorp_Blocks ((const quint64*)(d_data + *(const quint64*)(d_data + 24)))
+#define tcorp_Files ((const tcorp_File*)(tcorp_Blocks + tcorp_Header[2] + 1))
+#define tcorp_Spans ((const TiogaSpan*)(tcorp_Files + tcorp_Header[3]))
+#define tcorp_Pool ((const char*)d_data + pad8((const char*)(tcorp_Spans + tcorp_Header[4]) - (const char*)d_data))
+
+QStringList TiogaCorpus::paths() const
+{
+    QStringList res;
+    if( d_data == 0 )
+        return res;
+    const tcorp_File* f = tcorp_Files;
+    for( quint32 i = 0; i < tcorp_Header[3]; i++ )
+        res << QString::fromUtf8(tcorp_Pool + f[i].pathOff, f[i].pathLen);
+    return res;
+}
+
+int TiogaCorpus::findPath(const QString& path) const
+{
+    if( d_data == 0 )
+        return -1;
+    const QByteArray p = path.toUtf8();
+    const tcorp_File* f = tcorp_Files;
+    const char* pool = tcorp_Pool;
+    int lo = 0, hi = int(tcorp_Header[3]) - 1;
+    while( lo <= hi )
+    {
+        const int mid = ( lo + hi ) / 2;
+        const int len = f[mid].pathLen;
+        int cmp = ::memcmp(pool + f[mid].pathOff, p.constData(), qMin(len, p.size()));
+        if( cmp == 0 )
+            cmp = len - p.size();
+        if( cmp == 0 )
+            return mid;
+        if( cmp < 0 )
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -1;
+}
+
+QByteArray TiogaCorpus::block(quint32 i) const
+{
+    // sequential reads mostly hit the same block again
+    QMutexLocker lock(&d_cacheLock);
+    if( i == d_cachedBlock )
+        return d_cached;
+    if( i >= tcorp_Header[2] )
+        return QByteArray();
+    const quint64 start = tcorp_Blocks[i];
+    const quint64 end = tcorp_Blocks[i+1];
+    if( end > quint64(d_size) || start > end )
+        return QByteArray();
+    d_cached = qUncompress(d_data + start, end - start);
+    d_cachedBlock = i;
+    return d_cached;
+}
+
+QByteArray TiogaCorpus::slice(quint64 off, quint64 len) const
+{
+    QByteArray res;
+    const quint32 blockSize = tcorp_Header[1];
+    while( len > 0 )
+    {
+        const QByteArray b = block(off / blockSize);
+        const int start = off % blockSize;
+        if( start >= b.size() )
+            break; // corrupt
+        const int n = qMin(quint64(b.size() - start), len);
+        res.append(b.constData() + start, n);
+        off += n;
+        len -= n;
+    }
+    return res;
+}
+
+bool TiogaCorpus::read(const QString& path, TiogaCorpus::Entry& e) const
+{
+    const int i = findPath(path);
+    if( i < 0 )
+        return false;
+    const tcorp_File& f = tcorp_Files[i];
+    e.path = path;
+    e.text.clear();
+    e.raw.clear();
+    if( f.flags & IsRaw )
+        e.raw = slice(f.off, f.len);
+    else
+        e.text = QString::fromUtf8(slice(f.off, f.len));
+    e.spans.resize(f.spanCount);
+    ::memcpy(e.spans.data(), tcorp_Spans + f.firstSpan, f.spanCount * sizeof(TiogaSpan));
+    e.tioga = f.flags & IsTioga;
+    e.code = f.flags & IsCode;
+    return true;
+}
+
+QString TiogaCorpus::lines(const QString& path, int first, int count) const
+{
+    const int i = findPath(path);
+    if( i < 0 || count <= 0 )
+        return QString();
+    const tcorp_File& f = tcorp_Files[i];
+    if( f.flags & IsRaw )
+    {
+        TiogaReader r;
+        if( !r.read(slice(f.off, f.len), path, false) )
+            return QString();
+        return r.text.section('\n', first, first + count - 1, QString::SectionIncludeTrailingSep);
+    }
+    // only the blocks up to the last line are decompressed
+    const quint32 blockSize = tcorp_Header[1];
+    QByteArray text;
+    quint64 off = f.off, len = f.len;
+    int from = -1, line = 0, pos = 0;
+    while( len > 0 )
+    {
+        const QByteArray b = block(off / blockSize);
+        const int start = off % blockSize;
+        if( start >= b.size() )
+            break; // corrupt
+        const int n = qMin(quint64(b.size() - start), len);
+        text.append(b.constData() + start, n);
+        off += n;
+        len -= n;
+        for( ; pos < text.size(); pos++ )
+        {
+            if( line == first && from < 0 )
+                from = pos;
+            if( text[pos] == '\n' && ++line == first + count )
+                return QString::fromUtf8(text.mid(from, pos + 1 - from));
+        }
+    }
+    if( line == first && from < 0 )
+        from = pos;
+    return from < 0 ? QString() : QString::fromUtf8(text.mid(from));
+}
@@ -0,0 +1,97 @@
+#ifndef TIOGACORPUS_H
+#define TIOGACORPUS_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "TiogaReader.h"
+#include <QMutex>
+#include <QStringList>
+
+class QFile;
+
+// One file holding the decoded text of a whole source tree. The texts are concatenated (as
+// UTF-8) and cut into blocks which are compressed independently; an index maps each path to
+// its offset in the concatenation, so a file or a range of its lines only costs the
+// decompression of the blocks it touches.
+class TiogaCorpus
+{
+public:
+    enum { DefaultBlockSize = 256 * 1024 };
+    struct Entry
+    {
+        QString path;
+        QString text;
+        QVector<TiogaSpan> spans;
+        QByteArray raw; // instead of text for documentation added with addRaw()
+        bool tioga, code;
+    };
+
+    TiogaCorpus();
+    ~TiogaCorpus();
+
+    static bool isCorpus(const QString& path); // by suffix
+    const QString& error() const { return d_error; }
+
+    // writing; add() can be called from many threads, the order of the files doesn't matter
+    bool create(const QString& path, int blockSize = DefaultBlockSize);
+    void add(const QString& path, const QString& text, const QVector<TiogaSpan>& spans, bool tioga, bool code);
+    // documentation in Tioga format is kept undecoded, so the viewer can render it in pages from
+    // the node tree; lines() decodes it to HTML
+    void addRaw(const QString& path, const char* data, int len);
+    bool commit();
+
+    // reading; the corpus file is mapped
+    bool open(const QString& path);
+    void close();
+    bool isOpen() const { return d_data != 0; }
+    QStringList paths() const;
+    bool read(const QString& path, Entry&) const;
+    QString lines(const QString& path, int first, int count) const; // first is 0 based
+protected:
+    int findPath(const QString&) const;
+    QByteArray slice(quint64 off, quint64 len) const;
+    QByteArray block(quint32 i) const;
+    void append(const QString& path, const char* data, int len, const QVector<TiogaSpan>& spans, quint32 flags);
+    bool flushBlock();
+    bool fail(const QString&);
+private:
+    struct FileRec
+    {
+        QByteArray path;
+        quint64 off;
+        quint32 len, firstSpan, spanCount, flags;
+    };
+    QString d_error;
+    // writing
+    QFile* d_out;
+    QMutex d_lock;
+    QByteArray d_raw; // the current, not yet compressed block
+    quint64 d_rawOff; // of d_raw in the concatenation
+    QList<quint64> d_blocks; // offset of each compressed block in the file
+    QList<FileRec> d_files;
+    QVector<TiogaSpan> d_spans;
+    int d_blockSize;
+    // reading
+    QFile* d_in;
+    const uchar* d_data;
+    qint64 d_size;
+    mutable QMutex d_cacheLock;
+    mutable quint32 d_cachedBlock;
+    mutable QByteArray d_cached; // the last block decompressed
+};
+
+#endif // TIOGACORPUS_H
@@ -0,0 +1,135 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "TiogaDocBuilder.h"
+#include <QTextDocument>
+
+static inline bool hasLook( quint32 looks, char c )
+{
+    // same bit order as tread_Reader::GetLookChars
+    return looks & ( 1u << ( 31 - ( c - 'a' ) ) );
+}
+
+TiogaDocBuilder::TiogaDocBuilder(QTextDocument* doc):d_cur(doc),d_first(doc->isEmpty())
+{
+    d_cur.movePosition(QTextCursor::End);
+    d_cur.beginEditBlock();
+}
+
+TiogaDocBuilder::~TiogaDocBuilder()
+{
+    d_cur.endEditBlock();
+}
+
+void TiogaDocBuilder::applyLooks(QTextCharFormat& f, quint32 looks)
+{
+    if( hasLook(looks,'b') )
+        f.setFontWeight(QFont::Bold);
+    if( hasLook(looks,'i') )
+        f.setFontItalic(true);
+    if( hasLook(looks,'u') )
+        f.setFontUnderline(true);
+    if( hasLook(looks,'o') )
+        f.setFontStrikeOut(true);
+}
+
+void TiogaDocBuilder::startNode(const QByteArray& format)
+{
+    d_level.push_back(format);
+    d_runs.clear();
+}
+
+void TiogaDocBuilder::endNode()
+{
+    if( !d_level.isEmpty() )
+        d_level.pop_back();
+}
+
+void TiogaDocBuilder::text(const char* str, int len, bool comment)
+{
+    QTextBlockFormat bf;
+    QTextCharFormat cf;
+    formatsFor(d_level.isEmpty() ? QByteArray() : d_level.back(), comment, bf, cf);
+    if( d_first )
+    {
+        d_cur.setBlockFormat(bf);
+        d_cur.setBlockCharFormat(cf);
+        d_first = false;
+    }else
+        d_cur.insertBlock(bf,cf);
+    d_positions.append(d_cur.position());
+
+    const QString text = TiogaReader::toString(str,len,true);
+    int pos = 0;
+    foreach( const Run& r, d_runs )
+    {
+        if( r.start >= text.size() )
+            break;
+        if( r.start > pos )
+            d_cur.insertText(text.mid(pos, r.start - pos), cf);
+        QTextCharFormat lf = cf;
+        applyLooks(lf, r.looks);
+        d_cur.insertText(text.mid(r.start, r.len), lf);
+        pos = r.start + r.len;
+    }
+    if( pos < text.size() )
+        d_cur.insertText(pos == 0 ? text : text.mid(pos), cf);
+    d_runs.clear();
+}
+
+void TiogaDocBuilder::looks(quint32 looks, int start, int len)
+{
+    if( looks == 0 )
+        return;
+    Run r;
+    r.looks = looks;
+    r.start = start;
+    r.len = len;
+    d_runs.append(r);
+}
+
+void TiogaDocBuilder::formatsFor(const QByteArray& f, bool comment, QTextBlockFormat& bf, QTextCharFormat& cf) const
+{
+    // the margins and sizes are the ones QTextDocument uses for the corresponding HTML tags
+    const int heading = TiogaReader::headingLevel(f, d_level.size() - 1);
+
+    if( f.startsWith("code") )
+    {
+        bf.setTopMargin(12);
+        bf.setBottomMargin(12);
+        bf.setNonBreakableLines(true);
+        cf.setFontFamily("Courier New");
+        cf.setFontFixedPitch(true);
+    }else if( heading )
+    {
+        static const int margins[] = { 18, 16, 14, 12, 12, 12 };
+        bf.setTopMargin(margins[heading-1]);
+        bf.setBottomMargin(12);
+        cf.setFontWeight(QFont::Bold);
+        cf.setProperty(QTextFormat::FontSizeAdjustment, 4 - heading );
+    }else if( comment )
+    {
+        bf.setTopMargin(12);
+        bf.setBottomMargin(12);
+        bf.setLeftMargin(40);
+        bf.setRightMargin(40);
+        cf.setFontItalic(true);
+    }else
+    {
+        bf.setTopMargin(12);
+        bf.setBottomMargin(12);
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef TIOGADOCBUILDER_H
+#define TIOGADOCBUILDER_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "TiogaReader.h"
+#include <QTextCursor>
+#include <QTextCharFormat>
+#include <QTextBlockFormat>
+#include <QByteArrayList>
+
+// Fills a QTextDocument directly from the decoded nodes of a documentation file; block
+// formats follow the Tioga format names like the HTML output, char formats follow the looks.
+class TiogaDocBuilder : public TiogaVisitor
+{
+public:
+    explicit TiogaDocBuilder(QTextDocument*);
+    ~TiogaDocBuilder();
+
+    static void applyLooks(QTextCharFormat&, quint32 looks);
+    // document position of the text of each node, in the order the nodes were visited
+    const QList<int>& positions() const { return d_positions; }
+
+    // TiogaVisitor
+    void startNode(const QByteArray& format);
+    void endNode();
+    void text(const char* str, int len, bool comment);
+    void looks(quint32 looks, int start, int len);
+protected:
+    void formatsFor(const QByteArray& format, bool comment, QTextBlockFormat&, QTextCharFormat&) const;
+private:
+    struct Run
+    {
+        quint32 looks;
+        int start, len;
+    };
+    QTextCursor d_cur;
+    QByteArrayList d_level;
+    QList<Run> d_runs; // of the current node
+    QList<int> d_positions;
+    bool d_first;
+};
+
+#endif // TIOGADOCBUILDER_H
@@ -0,0 +1,229 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "TiogaDocument.h"
+#include <QFile>
+
+TiogaDocument::TiogaDocument():d_file(0),d_data(0),d_len(0)
+{
+
+}
+
+TiogaDocument::~TiogaDocument()
+{
+    clear();
+}
+
+bool TiogaDocument::parse(const QByteArray& in)
+{
+    clear();
+    d_buf = in;
+    d_data = d_buf.constData();
+    d_len = d_buf.size();
+    return build();
+}
+
+bool TiogaDocument::load(const QString& path)
+{
+    clear();
+    d_file = new QFile(path);
+    if( !d_file->open(QIODevice::ReadOnly) )
+        return false;
+    d_len = d_file->size();
+    if( d_len == 0 )
+        return false;
+    d_data = (const char*)d_file->map(0,d_len);
+    if( d_data == 0 )
+    {
+        d_buf = d_file->readAll();
+        d_data = d_buf.constData();
+        d_len = d_buf.size();
+    }
+    return build();
+}
+
+void TiogaDocument::clear()
+{
+    d_nodes.clear();
+    d_runs.clear();
+    d_props.clear();
+    d_strings.clear();
+    d_formats.clear();
+    d_propNames.clear();
+    d_stack.clear();
+    d_last.clear();
+    d_buf.clear();
+    d_error.clear();
+    if( d_file )
+        delete d_file; // also unmaps the file
+    d_file = 0;
+    d_data = 0;
+    d_len = 0;
+}
+
+int TiogaDocument::firstChild(int i) const
+{
+    if( i + 1 < d_nodes.size() && d_nodes[i+1].parent == i )
+        return i + 1;
+    else
+        return -1;
+}
+
+QByteArray TiogaDocument::rawText(int i) const
+{
+    const Node& n = d_nodes[i];
+    return QByteArray::fromRawData(d_data + n.textOff, n.textLen);
+}
+
+QString TiogaDocument::text(int i) const
+{
+    const Node& n = d_nodes[i];
+    return TiogaReader::toString(d_data + n.textOff, n.textLen, true);
+}
+
+void TiogaDocument::visit(TiogaVisitor* v, int from, int to) const
+{
+    Q_ASSERT( v != 0 );
+    to = qMin(to, d_nodes.size());
+    if( from < 0 || from >= to )
+        return;
+    QVector<int> ancestors;
+    for( int p = d_nodes[from].parent; p >= 0; p = d_nodes[p].parent )
+        ancestors.prepend(p);
+    foreach( int p, ancestors )
+        v->startNode(format(p));
+    int open = ancestors.size();
+    for( int i = from; i < to; i++ )
+    {
+        const Node& n = d_nodes[i];
+        while( open > n.level )
+        {
+            v->endNode();
+            open--;
+        }
+        v->startNode(d_formats[n.format]);
+        open++;
+        for( quint32 j = 0; j < n.propCount; j++ )
+        {
+            const Prop& p = d_props[n.firstProp + j];
+            v->property(d_propNames[p.name], d_strings.constData() + p.valueOff, p.valueLen);
+        }
+        for( quint32 j = 0; j < n.runCount; j++ )
+        {
+            const Run& r = d_runs[n.firstRun + j];
+            v->looks(r.looks, r.start, r.len);
+        }
+        v->text(d_data + n.textOff, n.textLen, n.comment);
+    }
+    while( open-- > 0 )
+        v->endNode();
+}
+
+QByteArray TiogaDocument::propValue(const TiogaDocument::Prop& p) const
+{
+    return d_strings.mid(p.valueOff, p.valueLen);
+}
+
+bool TiogaDocument::build()
+{
+    d_formats.append(QByteArray()); // the null format
+    const bool res = TiogaReader::decode(d_data, d_len, this, 0, &d_error);
+    d_stack.clear();
+    d_last.clear();
+    d_nodes.squeeze();
+    d_runs.squeeze();
+    d_props.squeeze();
+    return res;
+}
+
+quint16 TiogaDocument::intern(QByteArrayList& l, const QByteArray& str)
+{
+    for( int i = 0; i < l.size(); i++ )
+    {
+        if( l[i] == str )
+            return i;
+    }
+    l.append(str);
+    return l.size() - 1;
+}
+
+void TiogaDocument::startNode(const QByteArray& format)
+{
+    const int level = d_stack.size();
+    Node n;
+    n.parent = level == 0 ? -1 : d_stack.last();
+    n.next = -1;
+    n.format = intern(d_formats, format);
+    n.level = qMin(level, 255);
+    n.comment = false;
+    n.textOff = n.textLen = 0;
+    n.firstRun = d_runs.size();
+    n.runCount = 0;
+    n.firstProp = d_props.size();
+    n.propCount = 0;
+    const int i = d_nodes.size();
+    d_nodes.append(n);
+
+    while( d_last.size() > level + 1 )
+        d_last.pop_back();
+    if( d_last.size() == level )
+        d_last.append(-1);
+    if( d_last[level] >= 0 )
+        d_nodes[d_last[level]].next = i;
+    d_last[level] = i;
+    d_stack.append(i);
+}
+
+void TiogaDocument::endNode()
+{
+    if( !d_stack.isEmpty() )
+        d_stack.pop_back();
+}
+
+void TiogaDocument::text(const char* str, int len, bool comment)
+{
+    if( d_stack.isEmpty() )
+        return;
+    Node& n = d_nodes[d_stack.last()];
+    n.textOff = str - d_data;
+    n.textLen = len;
+    n.comment = comment;
+}
+
+void TiogaDocument::looks(quint32 looks, int start, int len)
+{
+    if( d_stack.isEmpty() )
+        return;
+    Run r;
+    r.looks = looks;
+    r.start = start;
+    r.len = len;
+    d_runs.append(r);
+    d_nodes[d_stack.last()].runCount++;
+}
+
+void TiogaDocument::property(const QByteArray& name, const char* value, int len)
+{
+    if( d_stack.isEmpty() )
+        return;
+    Prop p;
+    p.name = intern(d_propNames, name);
+    p.valueOff = d_strings.size();
+    p.valueLen = len;
+    d_strings.append(value, len);
+    d_props.append(p);
+    d_nodes[d_stack.last()].propCount++;
+}
@@ -0,0 +1,104 @@
+#ifndef TIOGADOCUMENT_H
+#define TIOGADOCUMENT_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "TiogaReader.h"
+#include <QVector>
+#include <QByteArrayList>
+
+class QFile;
+
+// In-memory node tree of a Tioga file. The nodes are stored in document order in one array;
+// the text of a node is a slice of the original input which is only transcoded on request.
+class TiogaDocument : private TiogaVisitor
+{
+public:
+    struct Node
+    {
+        qint32 parent; // -1 for top-level nodes
+        qint32 next;   // next sibling or -1
+        quint16 format; // index into formats()
+        quint8 level;   // nesting depth, top-level nodes have level 0
+        quint8 comment; // text is in the comment region
+        quint32 textOff, textLen; // slice of data()
+        quint32 firstRun, runCount;
+        quint32 firstProp, propCount;
+    };
+    struct Run
+    {
+        quint32 looks;
+        quint32 start, len; // relative to the text of the node
+    };
+    struct Prop
+    {
+        quint16 name; // index into propNames()
+        quint32 valueOff, valueLen; // slice of the string arena
+    };
+
+    TiogaDocument();
+    ~TiogaDocument();
+
+    bool parse(const QByteArray&); // the document keeps a (shallow) copy of the data
+    bool load(const QString& path); // the document keeps the file mapped
+    void clear();
+    const QString& error() const { return d_error; } // set if the file is in Tioga format but corrupt
+
+    // replays the nodes from..to-1 in the order the decoder reports them; the ancestors of from
+    // are started first (without their text), so the visitor sees the original nesting
+    void visit(TiogaVisitor*, int from, int to) const;
+
+    int nodeCount() const { return d_nodes.size(); }
+    const Node& node(int i) const { return d_nodes[i]; }
+    int firstChild(int i) const;
+    const QByteArray& format(int i) const { return d_formats[d_nodes[i].format]; }
+    const QByteArrayList& formats() const { return d_formats; }
+    const QByteArrayList& propNames() const { return d_propNames; }
+
+    QByteArray rawText(int i) const; // not transcoded, newlines are CR
+    QString text(int i) const;
+    const Run* runs(int i) const { return d_runs.constData() + d_nodes[i].firstRun; }
+    const Prop* props(int i) const { return d_props.constData() + d_nodes[i].firstProp; }
+    QByteArray propValue(const Prop&) const;
+
+    const char* data() const { return d_data; }
+    int size() const { return d_len; }
+protected:
+    bool build();
+    quint16 intern(QByteArrayList&, const QByteArray&);
+
+    // TiogaVisitor
+    void startNode(const QByteArray& format);
+    void endNode();
+    void text(const char* str, int len, bool comment);
+    void looks(quint32 looks, int start, int len);
+    void property(const QByteArray& name, const char* value, int len);
+private:
+    QVector<Node> d_nodes;
+    QVector<Run> d_runs;
+    QVector<Prop> d_props;
+    QByteArray d_strings; // arena for property values
+    QByteArrayList d_formats, d_propNames;
+    QVector<qint32> d_stack, d_last; // open nodes and their last child during build
+    QByteArray d_buf;
+    QString d_error;
+    QFile* d_file;
+    const char* d_data;
+    int d_len;
+};
+
+#endif // TIOGADOCUMENT_H
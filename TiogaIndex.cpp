@@ -0,0 +1,310 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "TiogaIndex.h"
+#include <QFile>
+#include <QHash>
+#include <QSaveFile>
+#include <string.h>
+
+// File layout, all numbers are quint32 in host byte order so the file can be used mapped:
+//   header: magic, number of files, number of names, number of entries, size of the string pool
+//   files: offset and length of the UTF-8 path in the pool
+//   names: offset and length in the pool, first entry, number of entries; sorted by name bytes
+//   entries: file, node, type, offset and length of the value in the pool; sorted by file and node
+//   pool: the strings; equal values are stored once
+
+static const char s_magic[] = "TGX1";
+enum { HeaderLen = 5 * 4, FileLen = 2 * 4, NameLen = 4 * 4, EntryLen = 5 * 4 };
+
+void TiogaIndex::Collector::property(const QByteArray& name, const char* value, int len)
+{
+    if( d_nodes == 0 )
+        return;
+    Record r;
+    r.name = name;
+    r.value = QByteArray(value, len);
+    r.node = d_nodes - 1;
+    r.type = TiogaProperty::typeOf(name, value, len);
+    records.append(r);
+}
+
+TiogaIndex::TiogaIndex():d_mapped(0),d_data(0),d_size(0)
+{
+
+}
+
+TiogaIndex::~TiogaIndex()
+{
+    close();
+}
+
+bool TiogaIndex::collect(const char* data, int len, QList<TiogaIndex::Record>& out)
+{
+    Collector c;
+    const bool res = TiogaReader::decode(data, len, &c);
+    out += c.records;
+    return res;
+}
+
+void TiogaIndex::add(const QString& file, const QList<TiogaIndex::Record>& records)
+{
+    if( records.isEmpty() )
+        return;
+    QMutexLocker lock(&d_lock);
+    const quint32 f = d_files.size();
+    d_files.append(file);
+    foreach( const Record& r, records )
+    {
+        Entry e;
+        e.file = f;
+        e.node = r.node;
+        e.type = r.type;
+        e.value = r.value;
+        d_entries[r.name].append(e);
+    }
+}
+
+static inline void append(QByteArray& buf, quint32 v)
+{
+    buf.append((const char*)&v, 4);
+}
+
+static quint32 intern(QByteArray& pool, QHash<QByteArray,quint32>& offs, const QByteArray& str)
+{
+    QHash<QByteArray,quint32>::const_iterator i = offs.find(str);
+    if( i != offs.end() )
+        return i.value();
+    const quint32 off = pool.size();
+    pool.append(str);
+    offs.insert(str, off);
+    return off;
+}
+
+bool TiogaIndex::save(const QString& path)
+{
+    QMutexLocker lock(&d_lock);
+    QByteArray pool;
+    QHash<QByteArray,quint32> offs;
+    QByteArray files, names, entries;
+    foreach( const QString& f, d_files )
+    {
+        const QByteArray utf8 = f.toUtf8();
+        append(files, intern(pool, offs, utf8));
+        append(files, utf8.size());
+    }
+    quint32 nEntries = 0;
+    // QMap iterates in QByteArray order which is the memcmp order findName relies on
+    QMap<QByteArray, QList<Entry> >::iterator i;
+    for( i = d_entries.begin(); i != d_entries.end(); ++i )
+    {
+        // the workers add files in any order; sort so the hits of a file are adjacent
+        QList<Entry>& l = i.value();
+        QMap<quint64,int> order;
+        for( int j = 0; j < l.size(); j++ )
+            order.insertMulti((quint64(l[j].file) << 32) | l[j].node, j);
+        append(names, intern(pool, offs, i.key()));
+        append(names, i.key().size());
+        append(names, nEntries);
+        append(names, l.size());
+        foreach( int j, order )
+        {
+            const Entry& e = l[j];
+            append(entries, e.file);
+            append(entries, e.node);
+            append(entries, e.type);
+            append(entries, intern(pool, offs, e.value));
+            append(entries, e.value.size());
+        }
+        nEntries += l.size();
+    }
+    QByteArray header(s_magic, 4);
+    append(header, d_files.size());
+    append(header, d_entries.size());
+    append(header, nEntries);
+    append(header, pool.size());
+
+    QSaveFile out(path);
+    if( !out.open(QIODevice::WriteOnly) )
+        return false;
+    out.write(header);
+    out.write(files);
+    out.write(names);
+    out.write(entries);
+    out.write(pool);
+    return out.commit();
+}
+
+// an offset and length pair of a record
+static inline bool tindex_inPool(const quint32* r, quint32 poolLen)
+{
+    return r[0] <= poolLen && r[1] <= poolLen - r[0];
+}
+
+bool TiogaIndex::open(const QString& path)
+{
+    close();
+    d_mapped = new QFile(path);
+    if( !d_mapped->open(QIODevice::ReadOnly) )
+    {
+        close();
+        return false;
+    }
+    const qint64 size = d_mapped->size();
+    const uchar* data = size >= HeaderLen ? d_mapped->map(0, size) : 0;
+    if( data == 0 || ::memcmp(data, s_magic, 4) != 0 )
+    {
+        close();
+        return false;
+    }
+    const quint32* h = (const quint32*)data;
+    if( HeaderLen + qint64(h[1]) * FileLen + qint64(h[2]) * NameLen + qint64(h[3]) * EntryLen + h[4] != size )
+    {
+        close();
+        return false;
+    }
+    // the records are checked once here, so the queries can trust them
+    const quint32* files = (const quint32*)(data + HeaderLen);
+    const quint32* names = files + qint64(h[1]) * 2;
+    const quint32* entries = names + qint64(h[2]) * 4;
+    bool ok = true;
+    for( quint32 i = 0; ok && i < h[1]; i++ )
+        ok = tindex_inPool(files + i * 2, h[4]);
+    for( quint32 i = 0; ok && i < h[2]; i++ )
+    {
+        const quint32* n = names + i * 4;
+        ok = tindex_inPool(n, h[4]) && n[2] <= h[3] && n[3] <= h[3] - n[2];
+    }
+    for( quint32 i = 0; ok && i < h[3]; i++ )
+    {
+        const quint32* e = entries + qint64(i) * 5;
+        ok = e[0] < h[1] && tindex_inPool(e + 3, h[4]);
+    }
+    if( !ok )
+    {
+        close();
+        return false;
+    }
+    d_data = data;
+    d_size = size;
+    return true;
+}
+
+void TiogaIndex::close()
+{
+    if( d_mapped )
+        delete d_mapped; // also unmaps the file
+    d_mapped = 0;
+    d_data = 0;
+    d_size = 0;
+}
+
+// the sections of the mapped file
+#define tindex_Header ((const quint32*)d_data)
+#define tindex_Files ((const quint32*)(d_data + HeaderLen))
+#define tindex_Names (tindex_Files + tindex_Header[1] * 2)
+#define tindex_Entries (tindex_Names + tindex_Header[2] * 4)
+#define tindex_Pool ((const char*)(tindex_Entries + tindex_Header[3] * 5))
+
+QByteArrayList TiogaIndex::names() const
+{
+    QByteArrayList res;
+    if( d_data == 0 )
+        return res;
+    for( quint32 i = 0; i < tindex_Header[2]; i++ )
+        res << QByteArray(tindex_Pool + tindex_Names[i*4], tindex_Names[i*4+1]);
+    return res;
+}
+
+int TiogaIndex::findName(const QByteArray& name) const
+{
+    if( d_data == 0 )
+        return -1;
+    const quint32* names = tindex_Names;
+    const char* pool = tindex_Pool;
+    int lo = 0, hi = int(tindex_Header[2]) - 1;
+    while( lo <= hi )
+    {
+        const int mid = ( lo + hi ) / 2;
+        const quint32 len = names[mid*4+1];
+        int cmp = ::memcmp(pool + names[mid*4], name.constData(), qMin(int(len), name.size()));
+        if( cmp == 0 )
+            cmp = int(len) - name.size();
+        if( cmp == 0 )
+            return mid;
+        if( cmp < 0 )
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -1;
+}
+
+QString TiogaIndex::fileName(quint32 file) const
+{
+    return QString::fromUtf8(tindex_Pool + tindex_Files[file*2], tindex_Files[file*2+1]);
+}
+
+QList<TiogaIndex::Hit> TiogaIndex::hits(int name, const QByteArray* value) const
+{
+    QList<Hit> res;
+    if( name < 0 )
+        return res;
+    const quint32* n = tindex_Names + name * 4;
+    const quint32* e = tindex_Entries + n[2] * 5;
+    const char* pool = tindex_Pool;
+    for( quint32 i = 0; i < n[3]; i++, e += 5 )
+    {
+        if( value && ( int(e[4]) != value->size() || ::memcmp(pool + e[3], value->constData(), e[4]) != 0 ) )
+            continue;
+        Hit h;
+        h.file = fileName(e[0]);
+        h.node = e[1];
+        h.type = e[2];
+        h.value = QByteArray(pool + e[3], e[4]);
+        res << h;
+    }
+    return res;
+}
+
+QList<TiogaIndex::Hit> TiogaIndex::find(const QByteArray& name) const
+{
+    return hits(findName(name), 0);
+}
+
+QList<TiogaIndex::Hit> TiogaIndex::find(const QByteArray& name, const QByteArray& value) const
+{
+    return hits(findName(name), &value);
+}
+
+QStringList TiogaIndex::filesWith(const QByteArray& name) const
+{
+    QStringList res;
+    const int i = findName(name);
+    if( i < 0 )
+        return res;
+    const quint32* n = tindex_Names + i * 4;
+    const quint32* e = tindex_Entries + n[2] * 5;
+    quint32 last = ~0u;
+    for( quint32 j = 0; j < n[3]; j++, e += 5 )
+    {
+        // the entries of a name are sorted by file
+        if( e[0] != last )
+            res << fileName(e[0]);
+        last = e[0];
+    }
+    return res;
+}
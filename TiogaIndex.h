@@ -0,0 +1,92 @@
+#ifndef TIOGAINDEX_H
+#define TIOGAINDEX_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "TiogaReader.h"
+#include <QByteArrayList>
+#include <QMutex>
+#include <QStringList>
+
+// Corpus wide index of the node properties: property name -> files and nodes -> value.
+// It is built from the decoded files, saved to disk and used memory mapped, so queries
+// don't have to decode anything.
+class TiogaIndex
+{
+public:
+    struct Record
+    {
+        QByteArray name;
+        QByteArray value;
+        quint32 node; // in document order, like the TiogaDocument node index
+        quint8 type;  // TiogaProperty::Type
+    };
+    // receives the properties of a file while it is decoded, e.g. by a TiogaReader
+    // with setVisitor(), so they don't need a pass of their own
+    class Collector : public TiogaVisitor
+    {
+    public:
+        QList<Record> records;
+        Collector():d_nodes(0){}
+        void begin(int) { d_nodes = 0; }
+        void startNode(const QByteArray&) { d_nodes++; }
+        void property(const QByteArray& name, const char* value, int len);
+    private:
+        quint32 d_nodes;
+    };
+    struct Hit
+    {
+        QString file;
+        quint32 node;
+        quint8 type;
+        QByteArray value;
+    };
+
+    TiogaIndex();
+    ~TiogaIndex();
+
+    // collecting; add() can be called from many threads
+    static bool collect(const char* data, int len, QList<Record>&); // false if not a Tioga file
+    void add(const QString& file, const QList<Record>&);
+    bool save(const QString& path);
+
+    // querying
+    bool open(const QString& path);
+    void close();
+    QByteArrayList names() const;
+    QList<Hit> find(const QByteArray& name) const;
+    QList<Hit> find(const QByteArray& name, const QByteArray& value) const;
+    QStringList filesWith(const QByteArray& name) const;
+protected:
+    int findName(const QByteArray&) const;
+    QList<Hit> hits(int name, const QByteArray* value) const;
+    QString fileName(quint32 file) const;
+private:
+    struct Entry
+    {
+        quint32 file, node, type;
+        QByteArray value;
+    };
+    QMutex d_lock;
+    QStringList d_files;
+    QMap<QByteArray, QList<Entry> > d_entries; // by property name, while collecting
+    QFile* d_mapped;
+    const uchar* d_data;
+    qint64 d_size;
+};
+
+#endif // TIOGAINDEX_H
@@ -16,10 +16,18 @@
 */
 
 #include "TiogaReader.h"
-#include <QIODevice>
-#include <QTextCursor>
+#include "TiogaCache.h"
+#include <QFile>
+#include <QStringList>
 #include <QtDebug>
-#include <QTextStream>
+#include <limits.h>
+#if defined(__AVX2__)
+#define TIOGA_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TIOGA_SSE2
+#include <emmintrin.h>
+#endif
 
 #define tioga_NumFormats	70
 #define tioga_NumLooks		50
@@ -114,8 +122,7 @@ struct tread_Stream {
 };
 
 struct tread_Reader {
-    QTextStream out;
-    bool isCode;
+    TiogaVisitor* visitor;
 
     /* Full buffer. */
     const char *buf;
@@ -136,6 +143,14 @@ struct tread_Reader {
     /* Property names */
     int nProps;
     QByteArray props[tioga_NumProps];
+    /* Sum of the rope lengths, known after Validate */
+    long ropeTotal;
+    /* Only report the node structure and the text of headings */
+    bool outline;
+    bool wantText;
+    /* Statistics, indexed like the tables above */
+    int formatCount[tioga_NumFormats];
+    int looksCount[tioga_NumLooks];
 
     static bool CheckID(unsigned char **pp, unsigned char *id)
     {
@@ -164,7 +179,7 @@ struct tread_Reader {
         return result;
     }
 
-    bool init(const char *buf, int len, bool code)
+    bool init(const char *buf, int len)
     {
         tread_Reader* r = this;
         unsigned char *p;
@@ -174,9 +189,10 @@ struct tread_Reader {
         static unsigned char commentID[] = { 0, 0 };
         static unsigned char controlID[] = { 0x9d, 0xca };
 
-        r->isCode = code;
         r->buf = buf;
         r->totalLen = len;
+        if (len < tioga_TrailerLen)
+            return false;
         /* Find the three main parts and verify that the lengths are ok. */
         p = ubuf + len - tioga_TrailerLen;
         if ( !CheckID(&p, trailerID) )
@@ -184,12 +200,16 @@ struct tread_Reader {
         propLen = GetLength(&p);
         textLen = GetLength(&p);
         totalSize = GetLength(&p);
-        if (totalSize != len || propLen > len || textLen > len)
+        if (totalSize != len || propLen > len || textLen < 0 ||
+                textLen > len - tioga_CommentHeaderLen - tioga_ControlHeaderLen - tioga_TrailerLen)
             return false;
         p = ubuf + textLen;
         if ( !CheckID(&p, commentID) )
             return false;
         commentLen = GetLength(&p);
+        if (commentLen < tioga_CommentHeaderLen ||
+                commentLen > len - textLen - tioga_ControlHeaderLen - tioga_TrailerLen)
+            return false;
         p = ubuf + textLen + commentLen;
         if ( !CheckID(&p, controlID) )
             return false;
@@ -217,6 +237,12 @@ struct tread_Reader {
         /* First property is NIL. */
         r->nProps = 1;
         r->props[0] = NULL;
+        r->visitor = 0;
+        r->ropeTotal = 0;
+        r->outline = false;
+        r->wantText = true;
+        memset(r->formatCount, 0, sizeof(r->formatCount));
+        memset(r->looksCount, 0, sizeof(r->looksCount));
         /* Preload system atoms. */
         AddProp("prefix");
         AddProp("postfix");
@@ -245,6 +271,90 @@ struct tread_Reader {
         }
     }
 
+    /* Walks the control stream once and checks all varints, strings and
+       ropes against the region limits, so DoWork can run without checks. */
+    bool Validate(QString* error)
+    {
+        unsigned char *p = control.next;
+        unsigned char * const limit = control.limit;
+        /* qint64, since long has 32 bits on 64-bit Windows and n + 1 would overflow there */
+        qint64 textLeft = text.limit - text.next;
+        qint64 comLeft = com.limit - com.next;
+        qint64 n, i;
+        long depth = 0; /* of the nodes with children, as level in DoWork */
+        int op;
+
+#define tread_Fail(msg) { if (error) *error = QString("%1 at control offset %2").arg(msg).arg(p - control.next); return false; }
+#define tread_Need(n) if (limit - p < (n)) tread_Fail("control stream truncated")
+#define tread_Int(res) { int nBits = 0; res = 0; \
+            for (;;) { tread_Need(1); if (nBits == 28 && (*p & 0xf8)) tread_Fail("number too large"); \
+                res |= (qint64)(*p & 0x7f) << nBits; nBits += 7; if (!(*p++ & 0x80)) break; } }
+
+        while (p < limit) {
+            op = *p++;
+            if (op == startNode || (startNodeFirst <= op && op <= startNodeLast))
+                ++depth;
+            else if (op == endNode && --depth < 0)
+                tread_Fail("too many endNodes");
+            switch (op) {
+            case startNode:
+            case terminalTextNode:
+            case prop:
+                tread_Need(1);
+                n = *p++;
+                tread_Need(n);
+                p += n;
+                if (op == prop) {
+                    tread_Int(n);
+                    tread_Need(n);
+                    p += n;
+                }
+                break;
+            case propShort:
+                tread_Need(1);
+                ++p;
+                tread_Int(n);
+                tread_Need(n);
+                p += n;
+                break;
+            case rope:
+            case comment:
+                tread_Int(n);
+                /* including the newline not passed to the client */
+                if (n + 1 > (op == rope ? textLeft : comLeft))
+                    tread_Fail("rope too long");
+                if (op == rope)
+                    textLeft -= n + 1;
+                else
+                    comLeft -= n + 1;
+                ropeTotal += n;
+                break;
+            case runs:
+                tread_Int(n);
+                for (i = 0; i < n; ++i) {
+                    tread_Need(1);
+                    op = *p++;
+                    qint64 rl = 0;
+                    if (op == looks)
+                        rl = 4;
+                    else if (look1 <= op && op <= look3)
+                        rl = op - look1 + 1;
+                    tread_Need(rl);
+                    p += rl;
+                    tread_Int(rl);
+                }
+                break;
+            default:
+                /* all other ops have no operands */
+                break;
+            }
+        }
+#undef tread_Int
+#undef tread_Need
+#undef tread_Fail
+        return true;
+    }
+
     void DoWork()
     {
         tread_Reader *r = this;
@@ -284,10 +394,17 @@ struct tread_Reader {
                 switch (op) {
                 case endNode:
                     /* todo */
-                    if (level >= 0)
+                    if (level > 0)
                         --level;
-                    else
+                    else {
+                        /* Validate rejects this; endOfFile would never end the loop */
                         qCritical() << "Too many endNodes.";
+                        return;
+                    }
+                    /* a terminal node ends implicitly with its parent */
+                    if (lastWasTerminal)
+                        EndNode();
+                    lastWasTerminal = false;
                     EndNode();
                     op = GetOp();
                     continue;
@@ -303,25 +420,34 @@ struct tread_Reader {
                     break;
                 case rope:
                 case comment:
+                {
                     length = GetInt();
-                    /* Get newline, just don't pass it to client. */
-                    SGetRope(op == rope ? &r->text : &r->com, length + 1);
-                    /* convert newlines if should */
-                    FixNewlines(r->str.data(), length + 1);
-                    InsertText(r->str.constData(), length, op == comment);
+                    tread_Stream* s = op == rope ? &r->text : &r->com;
+                    /* the text is passed to the client directly from the input buffer */
+                    const char* t = (const char*) s->next;
+                    /* Skip newline, just don't pass it to client. */
+                    s->next += length + 1;
+                    if (wantText && !(outline && op == comment))
+                        InsertText(t, length, op == comment);
                     if (runLen != 0 && runLen != length)
                         qCritical() << "Rope length(" << length << ") doesn't match run length(" << runLen << ")";
                     runLen = 0;
                     /* bump by one */
                     op = GetOp();
                     continue;
+                }
                 case runs:
                     nRuns = GetInt();
+                    if (outline) {
+                        SkipRuns(nRuns);
+                        op = GetOp();
+                        continue;
+                    }
 
                     runLen = 0;
                     for (i = 0; i < nRuns; ++i) {
                         int rl;
-                        int iLook;
+                        int iLook = 0;
                         op = GetOp();
                         if (looksFirst <= op && op <= looksLast)
                             /* Look it up. */
@@ -341,20 +467,32 @@ struct tread_Reader {
                             iLook = 0;
                         }
                         rl = GetInt();
-                        AddLooks(r->_looks[iLook], runLen, rl);
+                        AddRun(iLook, runLen, rl);
                         runLen += rl;
                     }
                     op = GetOp();
                     continue;
                 case prop:
+                    if (outline) {
+                        control.next += *control.next + 1;
+                        control.next += GetInt();
+                        op = GetOp();
+                        continue;
+                    }
                     GetStr();
                     iProp = AddProp(r->str.constData());
                     len = GetInt();
                     SGetRope( &r->control, len);
-                    HandleProp(r->props[iProp].constData(), r->str.constData(), len);
+                    HandleProp(r->props[iProp], r->str.constData(), len);
                     op = GetOp();
                     continue;
                 case propShort:
+                    if (outline) {
+                        ++control.next;
+                        control.next += GetInt();
+                        op = GetOp();
+                        continue;
+                    }
                     iProp = GetByte();
                     if (iProp >= r->nProps) {
                         qCritical() << "Property index(" << iProp << ") out of range.";
@@ -362,7 +500,7 @@ struct tread_Reader {
                     }
                     len = GetInt();
                     SGetRope(&r->control, len);
-                    HandleProp(r->props[iProp].constData(), r->str.constData(), len);
+                    HandleProp(r->props[iProp], r->str.constData(), len);
                     op = GetOp();
                     continue;
                 case endOfFile:
@@ -381,13 +519,18 @@ struct tread_Reader {
                     continue;
                 }
             }
-            if (level == 0 && op == endOfFile)
+            if (level == 0 && op == endOfFile) {
+                if (lastWasTerminal)
+                    EndNode();
                 break;
+            }
             /* If we make it here, then we want to start a new text node. */
             if (lastWasTerminal)
                 EndNode();
             lastWasTerminal = terminalNode;
-            StartNode(r->formats[iFormat]);
+            if (outline)
+                wantText = TiogaReader::headingLevel(formats[iFormat], level) != 0;
+            StartNode(iFormat);
             if (!terminalNode)
                 ++level;
             /* else stayed at same level */
@@ -403,6 +546,8 @@ struct tread_Reader {
             return endOfFile;
     }
 
+    /* The following functions don't check limits; Validate did that. */
+
     void GetStr()
     {
         long len = *control.next++;
@@ -410,21 +555,12 @@ struct tread_Reader {
         SGetRope(&control, len);
     }
 
-    bool SGetRope(tread_Stream *s, long len)
+    void SGetRope(tread_Stream *s, long len)
     {
-        long i;
-
-        if (EnsureStrLen(len + 1) < 0)
-            return false;
-        for (i = 0; i < len; ++i) {
-            if (s->next >= s->limit) {
-                qCritical() << "Rope too long.";
-                return false;
-            }
-            str.data()[i] = *s->next++;
-        }
+        EnsureStrLen(len + 1);
+        memcpy(str.data(), s->next, len);
+        s->next += len;
         str.data()[len] = 0;
-        return true;
     }
 
     bool EnsureStrLen(long len)
@@ -440,16 +576,6 @@ struct tread_Reader {
         return true;
     }
 
-    static void FixNewlines(char *s, long len)
-    {
-        while (len > 0) {
-            if (*s == '\r')
-                *s = '\n';
-            ++s;
-            --len;
-        }
-    }
-
     long GetLookChars(int n)
     {
         long l = 0;
@@ -469,9 +595,23 @@ struct tread_Reader {
 
     int GetByte()
     {
-        if (control.next < control.limit)
-            return *control.next++;
-        return 0;
+        return *control.next++;
+    }
+
+    void SkipRuns(int nRuns)
+    {
+        int i, op;
+
+        /* the looks table is not needed, nothing refers to it */
+        for (i = 0; i < nRuns; ++i) {
+            op = *control.next++;
+            if (op == looks)
+                control.next += 4;
+            else if (look1 <= op && op <= look3)
+                control.next += op - look1 + 1;
+            while (*control.next++ & 0x80)
+                ;
+        }
     }
 
     long GetInt()
@@ -531,147 +671,598 @@ struct tread_Reader {
         }
     }
 
+    void StartNode(int iFormat)
+    {
+        ++formatCount[iFormat];
+        visitor->startNode(formats[iFormat]);
+    }
+
+    void EndNode()
+    {
+        visitor->endNode();
+    }
+
+    void AddRun(int iLook, long start, int len)
+    {
+        ++looksCount[iLook];
+        visitor->looks(_looks[iLook], start, len);
+    }
+
+    void CollectStats(TiogaStats* stats) const
+    {
+        int i;
+
+        for (i = 0; i < nFormats; ++i) {
+            if (formatCount[i])
+                stats->formats[formats[i]] += formatCount[i];
+        }
+        for (i = 0; i < nLooks; ++i) {
+            if (looksCount[i])
+                stats->looks[(quint32) _looks[i]] += looksCount[i];
+        }
+    }
+
+    void InsertText(const char *t, int len, bool comment)
+    {
+        visitor->text(t, len, comment);
+    }
+
+    void HandleProp(const QByteArray& propName, const char *prop, long len)
+    {
+        visitor->property(propName, prop, len);
+    }
+
+};
+
+static void tread_transcode(const uchar* in, ushort* out, int len, bool fixNewlines);
+
+// Appends to a QString whose capacity is reserved up front, without the flush per line and
+// the temporary strings of a QTextStream
+struct tread_Out
+{
+    QString* str;
+    int len; // chars written so far; str is longer until finish()
+
+    tread_Out():str(0),len(0) {}
+
+    void setString(QString* s)
+    {
+        str = s;
+        len = 0;
+    }
+
+    void reserve(int n)
+    {
+        if (len + n > str->size())
+            str->resize(len + n);
+    }
+
+    ushort* grow(int n)
+    {
+        if (len + n > str->size())
+            str->resize(qMax(len + n, str->size() * 2));
+        ushort* p = (ushort*)str->data() + len;
+        len += n;
+        return p;
+    }
+
+    void latin1(const char* s, int n)
+    {
+        tread_transcode((const uchar*)s, grow(n), n, false);
+    }
+
+    void ascii(const char* s)
+    {
+        const int n = ::strlen(s);
+        ushort* p = grow(n);
+        for (int i = 0; i < n; i++)
+            p[i] = (uchar)s[i];
+    }
+
+    void fill(char c, int n)
+    {
+        ushort* p = grow(n);
+        for (int i = 0; i < n; i++)
+            p[i] = c;
+    }
+
+    void append(const QString& s)
+    {
+        ::memcpy(grow(s.size()), s.constData(), s.size() * sizeof(ushort));
+    }
+
+    void newline()
+    {
+        *grow(1) = '\n';
+    }
+
+    void finish()
+    {
+        str->resize(len);
+    }
+};
+
+struct tread_Writer : public TiogaVisitor
+{
+    tread_Out out;
     QByteArrayList level;
     // level corresponds to indent, not primarily to titel level
 
-    void StartNode(const char *format)
+    void begin(int textLen)
+    {
+        // the markup, indentation and comment prefixes usually add less than a quarter
+        out.reserve(textLen + textLen / 4);
+    }
+
+    void startNode(const QByteArray& format)
     {
-        const QByteArray f = format;
-        TiogaReader::__formats[f]++;
         level.push_back(format);
     }
 
-    void EndNode()
+    void endNode()
+    {
+        if( !level.isEmpty() )
+            level.pop_back();
+    }
+};
+
+static inline bool tread_isSpace(char c)
+{
+    // the Latin-1 chars QChar::isSpace accepts
+    switch( (uchar)c )
+    {
+    case ' ': case '\t': case '\n': case '\v': case '\f': case '\r': case 0x85: case 0xa0:
+        return true;
+    default:
+        return false;
+    }
+}
+
+struct tread_CodeWriter : public tread_Writer
+{
+    QVector<TiogaSpan>* spans; // looks runs aligned with the output
+    QList<TiogaSpan> runs; // of the current node, relative to its text
+
+    tread_CodeWriter(QVector<TiogaSpan>* s):spans(s) {}
+
+    void startNode(const QByteArray& format)
     {
-        level.pop_back();
+        tread_Writer::startNode(format);
+        runs.clear();
     }
 
-    void AddLooks(quint32 looks, long start, int len)
+    void looks(quint32 looks, int start, int len)
     {
-        const QByteArray l = QByteArray::number(looks,16);
-        TiogaReader::__looks[l]++;
-        // qDebug() << "*** AddLooks" << l << start << len;
+        if( looks == 0 )
+            return;
+        TiogaSpan r;
+        r.pos = start;
+        r.len = len;
+        r.looks = looks;
+        r.flags = 0;
+        runs.append(r);
     }
 
-    static QString toString( const char* in, int len )
+    void addSpans(int off, int len)
     {
-        const QString chars = QString::fromUtf8("©←");
-        QString out;
-        out.resize(len);
-        for( int i = 0; i < len; i++ )
+        foreach( const TiogaSpan& r, runs )
         {
-            const char ch = in[i];
-            switch( (quint8)ch )
+            const int start = qMax(int(r.pos), off);
+            const int end = qMin(int(r.pos + r.len), off + len);
+            if( start < end )
             {
-            case 0xd3: // this is 'Ó' in Latin-1 charset, convert to '©'
-                out[i] = chars[0];
-                break;
-            case 0xac: // this is '¬' in Latin-1 charset, convert to '←'
-            case '_':
-                out[i] = chars[1];
-                break;
-            default:
-                out[i] = QChar::fromLatin1(ch);
-                break;
+                TiogaSpan sp;
+                sp.pos = out.len + start - off;
+                sp.len = end - start;
+                sp.looks = r.looks;
+                sp.flags = 0;
+                spans->append(sp);
             }
         }
-        return out;
     }
 
-    void InsertText(const char *t, int len, bool comment)
+    void text(const char* t, int len, bool comment)
     {
-        if( isCode )
-        {
-            const QStringList lines = toString(t,len).split('\n');
-            out << QByteArray((level.size()-2) * 4,' ');
+        // the rope is transcoded line by line straight into the output; CR and LF end a line
+        out.fill(' ', qMax(level.size()-2, 0) * 4);
 
-            foreach( const QString& line, lines )
-            {
-                if( comment )
-                {
-                    const QString trimmed = line.trimmed();
-                    if( !trimmed.isEmpty() && !trimmed.startsWith("--") )
-                        out << "-- ";
-                    if( level.size() == 1 && trimmed.isEmpty() )
-                        return;
-                }
-                out << line << endl;
-            }
-        }else
+        int off = 0; // of the line in the text of the node
+        forever
         {
-            QString text = toString(t,len).toHtmlEscaped();
-            const QByteArray f = level.back();
-            if( f.startsWith("code") )
-                out << "<pre><code>" << text << "</code></pre>" << endl;
-            else if( f == "head" )
+            int end = off;
+            while( end < len && t[end] != '\r' && t[end] != '\n' )
+                end++;
+            if( comment )
             {
-                QByteArray tag;
-                switch (level.size()-1)
+                int i = off, j = end;
+                while( i < j && tread_isSpace(t[i]) )
+                    i++;
+                while( j > i && tread_isSpace(t[j-1]) )
+                    j--;
+                if( i < j )
                 {
-                case 1:
-                    tag = "h1";
-                    break;
-                case 2:
-                    tag = "h2";
-                    break;
-                case 3:
-                    tag = "h3";
-                    break;
-                case 4:
-                    tag = "h4";
-                    break;
-                case 5:
-                    tag = "h5";
-                    break;
-                case 6:
-                    tag = "h6";
-                    break;
+                    TiogaSpan c;
+                    c.pos = out.len;
+                    if( !( j - i >= 2 && t[i] == '-' && t[i+1] == '-' ) )
+                        out.ascii("-- ");
+                    else
+                        c.pos += i - off;
+                    c.len = out.len + end - off - c.pos;
+                    c.looks = 0;
+                    c.flags = TiogaSpan::Comment;
+                    spans->append(c);
                 }
-                out << "<" << tag << ">" << text << "</" << tag << ">" << endl;
-            }else if( f.startsWith("head") )
-            {
-                const char digit = f[4];
-                out << "<h" << digit << ">" << text << "</h" << digit << ">" << endl;
-            }else if( comment )
-            {
-                out << "<blockquote><i>" << text << "</i></blockquote>" << endl;
-            }else
-            {
-                // out << "<u><sup>" << f << "</sup></u>" << endl; // TEST
-                text.replace('\t', "&#x0009;");
-                out << "<p>" << text << "</p>" << endl;
+                if( level.size() == 1 && i == j )
+                    break;
             }
+            if( !runs.isEmpty() )
+                addSpans(off, end - off);
+            out.latin1(t + off, end - off);
+            out.newline();
+            if( end >= len )
+                break;
+            off = end + 1;
         }
+        runs.clear();
     }
+};
 
-    void HandleProp(const char *propName, const char *prop, long len)
+struct tread_HtmlWriter : public tread_Writer
+{
+    void text(const char* t, int len, bool comment)
     {
-        // qDebug() << "*** HandleProp" << propName << QByteArray(prop,len);
+        QString text = TiogaReader::toString(t,len,true).toHtmlEscaped();
+        const QByteArray f = level.isEmpty() ? QByteArray() : level.back();
+        if( f.startsWith("code") )
+        {
+            out.ascii("<pre><code>");
+            out.append(text);
+            out.ascii("</code></pre>");
+        }else if( const int h = TiogaReader::headingLevel(f, level.size()-1) )
+        {
+            const char open[] = { '<', 'h', char('0' + h), '>', 0 };
+            const char close[] = { '<', '/', 'h', char('0' + h), '>', 0 };
+            out.ascii(open);
+            out.append(text);
+            out.ascii(close);
+        }else if( comment )
+        {
+            out.ascii("<blockquote><i>");
+            out.append(text);
+            out.ascii("</i></blockquote>");
+        }else
+        {
+            text.replace('\t', "&#x0009;");
+            out.ascii("<p>");
+            out.append(text);
+            out.ascii("</p>");
+        }
+        out.newline();
     }
+};
 
+// passes everything to the writer and to the visitor set with TiogaReader::setVisitor
+struct tread_Tee : public TiogaVisitor
+{
+    TiogaVisitor* a;
+    TiogaVisitor* b;
+    tread_Tee(TiogaVisitor* first, TiogaVisitor* second):a(first),b(second) {}
+    void begin(int textLen) { a->begin(textLen); b->begin(textLen); }
+    void startNode(const QByteArray& format) { a->startNode(format); b->startNode(format); }
+    void endNode() { a->endNode(); b->endNode(); }
+    void text(const char* str, int len, bool comment) { a->text(str, len, comment); b->text(str, len, comment); }
+    void looks(quint32 looks, int start, int len) { a->looks(looks, start, len); b->looks(looks, start, len); }
+    void property(const QByteArray& name, const char* value, int len)
+    {
+        a->property(name, value, len);
+        b->property(name, value, len);
+    }
 };
 
-QMap<QByteArray,int> TiogaReader::__formats, TiogaReader::__looks;
+void TiogaStats::merge(const TiogaStats& rhs)
+{
+    QMap<QByteArray,int>::const_iterator i;
+    for( i = rhs.formats.begin(); i != rhs.formats.end(); ++i )
+        formats[i.key()] += i.value();
+    QMap<quint32,int>::const_iterator j;
+    for( j = rhs.looks.begin(); j != rhs.looks.end(); ++j )
+        looks[j.key()] += j.value();
+}
+
+void TiogaStats::clear()
+{
+    formats.clear();
+    looks.clear();
+}
+
+TiogaReader::TiogaReader(QObject *parent) : QObject(parent),tioga(false),d_cache(0),d_visitor(0)
+{
+
+}
 
-TiogaReader::TiogaReader(QObject *parent) : QObject(parent)
+QStringList TiogaReader::nameFilters()
 {
+    static const char* suffix[] = {
+        "tioga",
+        "mesa",
+        "df",
+        "require",
+        "profile",
+        "depends",
+        0
+    };
+    QStringList res;
+    const char** p = suffix;
+    while( *p )
+    {
+        res << QString("*.%1").arg(*p) << QString("*.%1!*").arg(*p);
+        p++;
+    }
+    return res;
+}
 
+bool TiogaReader::isCodeFile(const QString& path)
+{
+    return path.endsWith(".mesa") || path.contains(".mesa!");
+}
+
+TiogaProperty::Type TiogaProperty::typeOf(const QByteArray& name, const char* value, int len)
+{
+    if( name == "prefix" || name == "postfix" )
+        return Style;
+    if( ( len == 4 && ::memcmp(value, "TRUE", 4) == 0 ) || ( len == 5 && ::memcmp(value, "FALSE", 5) == 0 ) )
+        return Bool;
+    int i = 0;
+    if( len > 1 && value[0] == '-' )
+        i++;
+    if( len == i || len - i > 18 )
+        return Text;
+    for( ; i < len; i++ )
+    {
+        if( value[i] < '0' || value[i] > '9' )
+            return Text;
+    }
+    return Number;
+}
+
+qint64 TiogaProperty::toNumber(const char* value, int len)
+{
+    return QByteArray::fromRawData(value, len).toLongLong();
 }
 
 bool TiogaReader::read(const QByteArray& in, const QString& fileName, bool code)
 {
-    tread_Reader r;
-    if( r.init(in.constData(), in.size(), code) )
-    {
-        r.out.setString(&text,QIODevice::WriteOnly);
-        if( !code )
-            r.out << "<html>" << endl;
-        r.DoWork();
-        if( !code )
-            r.out << "</html>" << endl;
+    return read(in.constData(), in.size(), fileName, code);
+}
+
+bool TiogaReader::read(QFile& in, const QString& fileName, bool code)
+{
+    const qint64 size = in.size();
+    if( size == 0 || size > INT_MAX )
+    {
+        text.clear();
+        spans.clear();
+        tioga = false;
+        error.clear();
+        if( size > INT_MAX ) // the decoder and QString work with int lengths
+            error = QString("%1: file too large").arg(fileName);
+        return error.isEmpty();
+    }
+    uchar* data = in.map(0,size);
+    if( data == 0 )
+        return read(in.readAll(), fileName, code);
+    const bool res = read((const char*)data, size, fileName, code);
+    in.unmap(data);
+    return res;
+}
+
+bool TiogaReader::read(const char* in, int len, const QString& fileName, bool code, const QByteArray& cacheKey)
+{
+    QByteArray key = cacheKey;
+    // a reused reader must not report the outcome of the previous file, not even on a cache hit
+    spans.clear();
+    error.clear();
+    tioga = false;
+    if( d_cache )
+    {
+        if( key.isEmpty() )
+            key = TiogaCache::key(in, len, code);
+        if( d_visitor == 0 && d_cache->lookup(key, text, tioga, &spans, &stats) )
+            return true;
+    }
+
+    text.clear();
+    TiogaStats s;
+    bool res;
+    if( code )
+    {
+        tread_CodeWriter w(&spans);
+        tread_Tee tee(&w, d_visitor);
+        w.out.setString(&text);
+        res = decode(in, len, d_visitor ? (TiogaVisitor*)&tee : &w, &s, &error);
+        w.out.finish();
     }else
-        text = tread_Reader::toString(in.constData(),in.size());
+    {
+        tread_HtmlWriter w;
+        tread_Tee tee(&w, d_visitor);
+        w.out.setString(&text);
+        w.out.ascii("<html>");
+        w.out.newline();
+        res = decode(in, len, d_visitor ? (TiogaVisitor*)&tee : &w, &s, &error);
+        w.out.ascii("</html>");
+        w.out.newline();
+        w.out.finish();
+    }
+    if( !error.isEmpty() )
+    {
+        // a Tioga file with a corrupt control stream; don't cache, the reader might be fixed
+        text.clear();
+        spans.clear();
+        tioga = false;
+        error = QString("%1: %2").arg(fileName).arg(error);
+        return false;
+    }
+    if( !res )
+        text = toString(in,len);
+    tioga = res;
+    stats.merge(s);
+
+    if( d_cache )
+        d_cache->insert(key, text, tioga, spans, s);
 
     return true;
 }
 
+bool TiogaReader::decode(QFile& in, TiogaVisitor* v, TiogaStats* stats, QString* error)
+{
+    const qint64 size = in.size();
+    if( size > INT_MAX )
+    {
+        if( error )
+            *error = "file too large";
+        return false;
+    }
+    uchar* data = size > 0 ? in.map(0,size) : 0;
+    if( data == 0 )
+    {
+        const QByteArray buf = in.readAll();
+        return decode(buf.constData(), buf.size(), v, stats, error);
+    }
+    const bool res = decode((const char*)data, size, v, stats, error);
+    in.unmap(data);
+    return res;
+}
+
+static bool tread_decode(const char* in, int len, TiogaVisitor* v, TiogaStats* stats, QString* error, bool outline)
+{
+    Q_ASSERT( v != 0 );
+    tread_Reader r;
+    if( !r.init(in, len) )
+        return false;
+    // nothing is passed to the visitor unless the whole control stream is sound
+    if( !r.Validate(error) )
+        return false;
+    r.visitor = v;
+    r.outline = outline;
+    v->begin(r.ropeTotal);
+    r.DoWork();
+    if( stats )
+        r.CollectStats(stats);
+    return true;
+}
+
+bool TiogaReader::decode(const char* in, int len, TiogaVisitor* v, TiogaStats* stats, QString* error)
+{
+    return tread_decode(in, len, v, stats, error, false);
+}
+
+bool TiogaReader::decodeOutline(const char* in, int len, TiogaVisitor* v, QString* error)
+{
+    return tread_decode(in, len, v, 0, error, true);
+}
+
+int TiogaReader::headingLevel(const QByteArray& format, int depth)
+{
+    int h = 0;
+    if( format == "head" )
+        h = depth;
+    else if( format.size() == 5 && format.startsWith("head") )
+        h = format[4] - '0';
+    return h >= 1 && h <= 6 ? h : 0;
+}
+
+// Latin-1 to UTF-16 with the Cedar character remapping: 0xd3 ('Ó') is '©', 0xac ('¬') and '_'
+// are '←'; optionally CR is converted to LF. The vector kernels widen 16 bytes at once and
+// only patch the lanes holding one of the remapped characters.
+
+struct tread_CharMap
+{
+    ushort map[2][256];
+    tread_CharMap()
+    {
+        for( int i = 0; i < 256; i++ )
+            map[0][i] = map[1][i] = i;
+        map[0][0xd3] = map[1][0xd3] = 0x00a9;
+        map[0][0xac] = map[1][0xac] = 0x2190;
+        map[0]['_'] = map[1]['_'] = 0x2190;
+        map[1]['\r'] = '\n';
+    }
+};
+static const tread_CharMap s_charMap;
+
+static void tread_transcode(const uchar* in, ushort* out, int len, bool fixNewlines)
+{
+    int i = 0;
+#if defined(TIOGA_AVX2)
+    const __m256i us = _mm256_set1_epi16('_');
+    const __m256i neg = _mm256_set1_epi16(0xac);
+    const __m256i copy = _mm256_set1_epi16(0xd3);
+    // widened bytes never equal 0xffff, so nothing matches if newlines are kept
+    const __m256i cr = _mm256_set1_epi16(fixNewlines ? '\r' : -1);
+    const __m256i arrow = _mm256_set1_epi16(0x2190);
+    const __m256i copyright = _mm256_set1_epi16(0x00a9);
+    const __m256i lf = _mm256_set1_epi16('\n');
+    for( ; i + 16 <= len; i += 16 )
+    {
+        __m256i w = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(in + i)));
+        const __m256i a = _mm256_or_si256(_mm256_cmpeq_epi16(w, us), _mm256_cmpeq_epi16(w, neg));
+        const __m256i c = _mm256_cmpeq_epi16(w, copy);
+        const __m256i n = _mm256_cmpeq_epi16(w, cr);
+        if( !_mm256_testz_si256(_mm256_or_si256(_mm256_or_si256(a, c), n), _mm256_set1_epi8(-1)) )
+        {
+            w = _mm256_blendv_epi8(w, arrow, a);
+            w = _mm256_blendv_epi8(w, copyright, c);
+            w = _mm256_blendv_epi8(w, lf, n);
+        }
+        _mm256_storeu_si256((__m256i*)(out + i), w);
+    }
+#elif defined(TIOGA_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i us = _mm_set1_epi8('_');
+    const __m128i neg = _mm_set1_epi8((char)0xac);
+    const __m128i copy = _mm_set1_epi8((char)0xd3);
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i fix = _mm_set1_epi8(fixNewlines ? -1 : 0);
+    const __m128i arrow = _mm_set1_epi16(0x2190);
+    const __m128i copyright = _mm_set1_epi16(0x00a9);
+    const __m128i lf = _mm_set1_epi16('\n');
+    for( ; i + 16 <= len; i += 16 )
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        const __m128i a = _mm_or_si128(_mm_cmpeq_epi8(v, us), _mm_cmpeq_epi8(v, neg));
+        const __m128i c = _mm_cmpeq_epi8(v, copy);
+        const __m128i n = _mm_and_si128(_mm_cmpeq_epi8(v, cr), fix);
+        if( _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, c), n)) != 0 )
+        {
+            // duplicate the byte masks to 16 bit lanes and select the replacements
+            __m128i m = _mm_unpacklo_epi8(a, a);
+            lo = _mm_or_si128(_mm_andnot_si128(m, lo), _mm_and_si128(m, arrow));
+            m = _mm_unpackhi_epi8(a, a);
+            hi = _mm_or_si128(_mm_andnot_si128(m, hi), _mm_and_si128(m, arrow));
+            m = _mm_unpacklo_epi8(c, c);
+            lo = _mm_or_si128(_mm_andnot_si128(m, lo), _mm_and_si128(m, copyright));
+            m = _mm_unpackhi_epi8(c, c);
+            hi = _mm_or_si128(_mm_andnot_si128(m, hi), _mm_and_si128(m, copyright));
+            m = _mm_unpacklo_epi8(n, n);
+            lo = _mm_or_si128(_mm_andnot_si128(m, lo), _mm_and_si128(m, lf));
+            m = _mm_unpackhi_epi8(n, n);
+            hi = _mm_or_si128(_mm_andnot_si128(m, hi), _mm_and_si128(m, lf));
+        }
+        _mm_storeu_si128((__m128i*)(out + i), lo);
+        _mm_storeu_si128((__m128i*)(out + i + 8), hi);
+    }
+#endif
+    const ushort* map = s_charMap.map[fixNewlines ? 1 : 0];
+    for( ; i < len; i++ )
+        out[i] = map[in[i]];
+}
+
+QString TiogaReader::toString( const char* in, int len, bool fixNewlines )
+{
+    QString out;
+    out.resize(len);
+    tread_transcode((const uchar*)in, (ushort*)out.data(), len, fixNewlines);
+    return out;
+}
@@ -18,16 +18,90 @@
 */
 
 #include <QObject>
+#include <QMap>
+#include <QVector>
 
-class TiogaReader : public QObject
+class QFile;
+class TiogaCache;
+
+// Histogram of the formats and looks vectors used by the nodes and runs of decoded files;
+// each reader counts on its own, the results can be merged afterwards.
+struct TiogaStats
+{
+    QMap<QByteArray,int> formats;
+    QMap<quint32,int> looks;
+    void merge(const TiogaStats&);
+    void clear();
+};
+
+// A run of chars with the same looks; each looks char 'a'..'z' is a bit, 'a' is the MSB.
+// In code mode a span with the Comment flag marks a line of a comment node, from the leading
+// "--" to the end of the line, so the lexer doesn't have to find comments again; its looks are 0.
+struct TiogaSpan
+{
+    enum Flag { Comment = 1 }; // not in looks, every one of its 32 bits can be set by a file
+    quint32 pos, len;
+    quint32 looks;
+    quint32 flags;
+};
+
+// The value of a node property classified by its name and syntax; prefix and postfix hold
+// style machine code which is kept as text
+struct TiogaProperty
+{
+    enum Type { Text, Style, Number, Bool };
+    static Type typeOf(const QByteArray& name, const char* value, int len);
+    static qint64 toNumber(const char* value, int len); // valid if typeOf is Number
+};
+
+// Receives the contents of a Tioga file as it is decoded. Nodes nest; looks runs, properties
+// and text belong to the most recently started node. The looks runs precede the text.
+class TiogaVisitor
 {
 public:
-    static QMap<QByteArray,int> __formats, __looks;
+    virtual ~TiogaVisitor() {}
+    virtual void begin(int textLen) {} // before the first node; the sum of all rope lengths
+    virtual void startNode(const QByteArray& format) {}
+    virtual void endNode() {}
+    // str points into the input buffer and is not zero terminated; newlines are still CR
+    virtual void text(const char* str, int len, bool comment) {}
+    virtual void looks(quint32 looks, int start, int len) {}
+    virtual void property(const QByteArray& name, const char* value, int len) {}
+};
 
+class TiogaReader : public QObject
+{
+public:
     explicit TiogaReader(QObject *parent = 0);
 
     bool read(const QByteArray&, const QString& fileName, bool code);
+    // key is the TiogaCache::key of the data, if the caller has it already
+    bool read(const char* data, int len, const QString& fileName, bool code, const QByteArray& key = QByteArray());
+    bool read(QFile&, const QString& fileName, bool code); // decodes straight from the memory mapped file
+    void setCache(TiogaCache* c) { d_cache = c; } // optional, not owned
+    // optional, not owned; also receives everything read() decodes, e.g. to collect the properties
+    // for an index in the same pass; the cache is then bypassed, since a hit wouldn't decode anything
+    void setVisitor(TiogaVisitor* v) { d_visitor = v; }
     QString text;
+    QVector<TiogaSpan> spans; // the looks runs and comment lines of the text, only in code mode
+    TiogaStats stats; // accumulates over all files read by this instance
+    bool tioga; // the last file read was in Tioga format, otherwise text is just transcoded
+    QString error; // why read() failed
+
+    static QStringList nameFilters(); // the files of the source tree which can be read
+    static bool isCodeFile(const QString& path);
+
+    // false if data is not in Tioga format; if it is but the file is corrupt, error is set in addition
+    static bool decode(const char* data, int len, TiogaVisitor*, TiogaStats* = 0, QString* error = 0);
+    static bool decode(QFile&, TiogaVisitor*, TiogaStats* = 0, QString* error = 0);
+    // only the nodes and the text of headings, no other text, comments, looks or properties
+    static bool decodeOutline(const char* data, int len, TiogaVisitor*, QString* error = 0);
+    // 1..6 if a node with the format at the given nesting depth is a heading, otherwise 0
+    static int headingLevel(const QByteArray& format, int depth);
+    static QString toString( const char* latin1, int len, bool fixNewlines = false );
+private:
+    TiogaCache* d_cache;
+    TiogaVisitor* d_visitor;
 };
 
 #endif // TIOGAREADER_H
@@ -0,0 +1,126 @@
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "TiogaStore.h"
+#include "TiogaCache.h"
+#include <QFile>
+
+TiogaStore::TiogaStore():d_cache(0),d_keepText(true),d_keepProperties(false)
+{
+
+}
+
+TiogaStore::~TiogaStore()
+{
+
+}
+
+TiogaStore::Ref TiogaStore::get(const QString& path, bool code, bool* shared)
+{
+    QFile in(path);
+    if( !in.open(QIODevice::ReadOnly) )
+        return Ref();
+    const qint64 size = in.size();
+    QByteArray buf;
+    const char* data = size > 0 ? (const char*)in.map(0,size) : 0;
+    if( data == 0 )
+    {
+        buf = in.readAll();
+        data = buf.constData();
+    }
+    const int len = data == buf.constData() ? buf.size() : size;
+    return get(path, data, len, code, shared);
+}
+
+TiogaStore::Ref TiogaStore::get(const QString& path, const char* data, int len, bool code, bool* shared)
+{
+    // the same key as the disk cache; it is passed to the reader, so the hash is only computed
+    // once per file
+    const QByteArray key = TiogaCache::key(data, len, code);
+    QSharedPointer<Slot> slot;
+    {
+        QMutexLocker lock(&d_lock);
+        d_byPath[path] = key;
+        slot = d_byKey.value(key);
+        if( shared )
+            *shared = !slot.isNull();
+        if( slot.isNull() )
+        {
+            slot = QSharedPointer<Slot>(new Slot());
+            d_byKey.insert(key, slot);
+        }
+    }
+
+    QMutexLocker lock(&slot->lock);
+    if( slot->artifact.isNull() )
+    {
+        QSharedPointer<Artifact> a(new Artifact());
+        a->key = key;
+        TiogaReader r;
+        r.setCache(d_cache);
+        TiogaIndex::Collector props;
+        if( d_keepProperties )
+            r.setVisitor(&props);
+        a->ok = r.read(data, len, path, code, key);
+        a->properties = props.records;
+        a->tioga = r.tioga;
+        a->text = r.text;
+        a->spans = r.spans;
+        a->stats = r.stats;
+        a->error = r.error;
+        if( a->ok && code )
+            parse(path, *a);
+        if( !d_keepText )
+        {
+            a->text.clear();
+            a->spans.clear();
+        }
+        slot->artifact = a;
+    }
+    return slot->artifact;
+}
+
+TiogaStore::Ref TiogaStore::find(const QString& path) const
+{
+    QSharedPointer<Slot> slot;
+    {
+        QMutexLocker lock(&d_lock);
+        slot = d_byKey.value(d_byPath.value(path));
+    }
+    if( slot.isNull() )
+        return Ref();
+    QMutexLocker lock(&slot->lock);
+    return slot->artifact;
+}
+
+int TiogaStore::pathCount() const
+{
+    QMutexLocker lock(&d_lock);
+    return d_byPath.size();
+}
+
+int TiogaStore::contentCount() const
+{
+    QMutexLocker lock(&d_lock);
+    return d_byKey.size();
+}
+
+void TiogaStore::clear()
+{
+    QMutexLocker lock(&d_lock);
+    d_byKey.clear();
+    d_byPath.clear();
+}
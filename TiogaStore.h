@@ -0,0 +1,83 @@
+#ifndef TIOGASTORE_H
+#define TIOGASTORE_H
+
+/*
+** Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+**
+** This file is part of the Cedar/Mesa project.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+*/
+
+#include "TiogaIndex.h"
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
+
+// Content addressed store of decoded files; the versions "x.mesa!1", "x.mesa!2" etc. of a file
+// are often identical, so each distinct content is decoded (and parsed) only once and all
+// paths with that content share the same artifact. get() can be called from many threads.
+class TiogaStore
+{
+public:
+    struct Issue
+    {
+        int row, col;
+        QString msg;
+    };
+    struct Artifact
+    {
+        QByteArray key; // hash of the raw bytes and the output mode
+        bool ok;    // false if the file is corrupt, see error
+        bool tioga;
+        QString text;
+        QVector<TiogaSpan> spans;
+        TiogaStats stats;
+        QString error;
+        QList<Issue> issues; // of the parser, if any
+        QList<TiogaIndex::Record> properties; // only with setKeepProperties
+        Artifact():ok(false),tioga(false){}
+    };
+    typedef QSharedPointer<const Artifact> Ref;
+
+    TiogaStore();
+    virtual ~TiogaStore();
+
+    void setCache(TiogaCache* c) { d_cache = c; } // optional, not owned
+    // if false, the text and spans of an artifact are dropped after parse(), and only the
+    // outcome, stats and issues are kept; get() then returns artifacts without text
+    void setKeepText(bool b) { d_keepText = b; }
+    // if true, the node properties are collected while a content is decoded, e.g. for a TiogaIndex
+    void setKeepProperties(bool b) { d_keepProperties = b; }
+    // null if the file cannot be read; shared is set if the content was already in the store
+    Ref get(const QString& path, bool code, bool* shared = 0);
+    Ref get(const QString& path, const char* data, int len, bool code, bool* shared = 0);
+    Ref find(const QString& path) const; // of a path already passed to get()
+    int pathCount() const;
+    int contentCount() const;
+    void clear();
+protected:
+    virtual void parse(const QString& path, Artifact&) {} // called once per distinct code content
+private:
+    struct Slot
+    {
+        QMutex lock; // held while the artifact is made, so others with the same content wait
+        QSharedPointer<Artifact> artifact;
+    };
+    mutable QMutex d_lock;
+    QHash<QByteArray, QSharedPointer<Slot> > d_byKey;
+    QHash<QString, QByteArray> d_byPath;
+    TiogaCache* d_cache;
+    bool d_keepText;
+    bool d_keepProperties;
+};
+
+#endif // TIOGASTORE_H
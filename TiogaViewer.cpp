@@ -15,7 +15,13 @@
 */
 
 #include "TiogaReader.h"
+#include "TiogaArchive.h"
+#include "TiogaCorpus.h"
+#include "TiogaCache.h"
+#include "TiogaDocBuilder.h"
+#include "TiogaDocument.h"
 #include "TiogaViewer.h"
+#include "CedarDiff.h"
 #include "CedarHighlighter.h"
 #include "CedarParser.h"
 #include "CedarLexer.h"
@@ -27,6 +33,7 @@
 #include <QFileInfo>
 #include <QLabel>
 #include <QPlainTextEdit>
+#include <QScrollBar>
 #include <QShortcut>
 #include <QStackedWidget>
 #include <QTextBrowser>
@@ -34,9 +41,15 @@
 #include <QVBoxLayout>
 #include <QtDebug>
 #include <QHeaderView>
+#include <algorithm>
 
-TiogaViewer::TiogaViewer(QWidget *parent) : QMainWindow(parent),d_errs(0)
+TiogaViewer::TiogaViewer(QWidget *parent) : QMainWindow(parent),d_errs(0),d_rendered(0),d_renderPending(false)
 {
+    d_cache = new TiogaCache();
+    d_doc = new TiogaDocument();
+    d_archive = new TiogaArchive();
+    d_corpus = new TiogaCorpus();
+
     QWidget* pane = new QWidget(this);
     QVBoxLayout* vbox = new QVBoxLayout(pane);
     vbox->setMargin(0);
@@ -50,7 +63,11 @@ TiogaViewer::TiogaViewer(QWidget *parent) : QMainWindow(parent),d_errs(0)
     vbox->addWidget(d_switch);
 
     d_docViewer = new QTextBrowser(this);
+    d_docViewer->document()->setUndoRedoEnabled(false);
     d_switch->addWidget(d_docViewer);
+    // more pages are rendered when the user scrolls near the end of what is rendered so far
+    connect(d_docViewer->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(onDocScrolled()));
+    connect(d_docViewer->verticalScrollBar(), SIGNAL(rangeChanged(int,int)), this, SLOT(onDocScrolled()));
 
     d_codeViewer = new QPlainTextEdit(this);
     d_codeViewer->setReadOnly(true);
@@ -58,7 +75,7 @@ TiogaViewer::TiogaViewer(QWidget *parent) : QMainWindow(parent),d_errs(0)
     d_codeViewer->setTabStopWidth( 30 );
     d_codeViewer->setTabChangesFocus(true);
     d_codeViewer->setMouseTracking(true);
-    Cedar::Highlighter* hl = new Cedar::Highlighter(d_codeViewer->document());
+    d_hl = new Cedar::Highlighter(d_codeViewer->document());
     const QByteArrayList builtins
             = QByteArrayList() << "ATOM" << "BOOL" << "BOOLEAN" << "CARDINAL" << "CHAR" << "CHARACTER" << "CODE"
                                << "ELSE" << "ISTYPE" << "PACKED" << "SIGNAL" << "ENABLE" << "JOIN" << "PAINTED"
@@ -77,7 +94,7 @@ TiogaViewer::TiogaViewer(QWidget *parent) : QMainWindow(parent),d_errs(0)
                                << "INTERNAL" << "OVERLAID" << "SHARES"
                                << "TRUE" << "FALSE" << "CARD";
     foreach( const QByteArray& bi, builtins )
-        hl->addBuiltIn(bi);
+        d_hl->addBuiltIn(bi);
 
 #if defined(Q_OS_WIN32)
     QFont monospace("Consolas");
@@ -98,14 +115,26 @@ TiogaViewer::TiogaViewer(QWidget *parent) : QMainWindow(parent),d_errs(0)
     setCorner( Qt::TopRightCorner, Qt::RightDockWidgetArea );
     setCorner( Qt::TopLeftCorner, Qt::LeftDockWidgetArea );
     createFileTree();
-#ifdef HAVE_PARSER
-    createErrs();
+    createOutline();
+    createErrs(); // the parser issues (with HAVE_PARSER) and the changes found by onDiff
+#ifndef HAVE_PARSER
+    d_errs->parentWidget()->hide();
 #endif
 
     new QShortcut(tr("CTRL+O"),this,SLOT(onOpen()));
+    new QShortcut(tr("CTRL+SHIFT+O"),this,SLOT(onOpenArchive()));
+    new QShortcut(tr("CTRL+D"),this,SLOT(onDiff()));
     new QShortcut(tr("CTRL+Q"),this,SLOT(close()));
 }
 
+TiogaViewer::~TiogaViewer()
+{
+    delete d_cache;
+    delete d_doc;
+    delete d_archive;
+    delete d_corpus;
+}
+
 template<class T>
 static bool fillFiles( T* parent, const QDir& dir, const QStringList& suffix, const QIcon& folder, const QIcon& file )
 {
@@ -138,25 +167,54 @@ static bool fillFiles( T* parent, const QDir& dir, const QStringList& suffix, co
     return hasFiles;
 }
 
-static QStringList filter()
+static bool dirsFirst( const QStringList& a, const QStringList& b )
 {
-    static const char* suffix[] = {
-        "tioga",
-        "mesa",
-        "df",
-        "require",
-        "profile",
-        "depends",
-        0
-    };
-    QStringList res;
-    const char** p = suffix;
-    while( *p )
+    // the order of fillFiles: in each directory the subdirectories come first, then the files
+    for( int i = 0; i < a.size() && i < b.size(); i++ )
     {
-        res << QString("*.%1").arg(*p) << QString("*.%1!*").arg(*p);
-        p++;
+        if( a[i] == b[i] )
+            continue;
+        const bool aIsDir = i < a.size() - 1;
+        const bool bIsDir = i < b.size() - 1;
+        if( aIsDir != bIsDir )
+            return aIsDir;
+        return a[i] < b[i];
+    }
+    return a.size() < b.size();
+}
+
+void TiogaViewer::fillNames(const QStringList& names)
+{
+    QFileIconProvider fip;
+    const QIcon folder = fip.icon(QFileIconProvider::Folder);
+    const QIcon file = fip.icon(QFileIconProvider::File);
+    QList<QStringList> paths;
+    foreach( const QString& name, names )
+        paths << name.split('/');
+    std::sort(paths.begin(), paths.end(), dirsFirst);
+    QHash<QString,QTreeWidgetItem*> dirs;
+    foreach( const QStringList& parts, paths )
+    {
+        QTreeWidgetItem* parent = 0;
+        QString path = d_root;
+        for( int i = 0; i < parts.size(); i++ )
+        {
+            path += "/" + parts[i];
+            const bool isFile = i == parts.size() - 1;
+            QTreeWidgetItem* item = isFile ? 0 : dirs.value(path);
+            if( item == 0 )
+            {
+                const int type = isFile ? QFileIconProvider::File : QFileIconProvider::Folder;
+                item = parent ? new QTreeWidgetItem(parent, type) : new QTreeWidgetItem(d_fileTree, type);
+                item->setText(0,parts[i]);
+                item->setToolTip(0,path);
+                item->setIcon(0,isFile ? file : folder);
+                if( !isFile )
+                    dirs.insert(path, item);
+            }
+            parent = item;
+        }
     }
-    return res;
 }
 
 void TiogaViewer::setRootPath(const QString& path)
@@ -171,7 +229,22 @@ void TiogaViewer::setRootPath(const QString& path)
     QFileIconProvider fip; // fip is apparently quite slow
     QIcon folder = fip.icon(QFileIconProvider::Folder);
     QIcon file = fip.icon(QFileIconProvider::File);
-    fillFiles( d_fileTree, path, filter(), folder, file );
+    d_archive->close();
+    d_corpus->close();
+    if( TiogaArchive::isArchive(path) )
+    {
+        if( d_archive->open(path) )
+            fillNames(d_archive->files(TiogaReader::nameFilters()));
+        else
+            d_title->setText(d_archive->error());
+    }else if( TiogaCorpus::isCorpus(path) )
+    {
+        if( d_corpus->open(path) )
+            fillNames(d_corpus->paths());
+        else
+            d_title->setText(d_corpus->error());
+    }else
+        fillFiles( d_fileTree, path, TiogaReader::nameFilters(), folder, file );
     QApplication::restoreOverrideCursor();
 }
 
@@ -179,38 +252,203 @@ void TiogaViewer::openFile(const QString& file)
 {
     const QString rfile = file.mid(d_root.size());
     d_title->setText(rfile);
+    d_current.clear();
+    d_codeViewer->setExtraSelections(QList<QTextEdit::ExtraSelection>());
+    if( d_corpus->isOpen() )
+    {
+        openDecoded(rfile.mid(1));
+        return;
+    }
+    // members of an archive are read into memory, files are mapped
+    QByteArray member;
     QFile in(file);
-    if( in.open(QIODevice::ReadOnly) )
+    const bool archived = d_archive->isOpen();
+    if( archived ? d_archive->read(d_archive->find(rfile.mid(1)), member) : in.open(QIODevice::ReadOnly) )
     {
-        const bool isCode = file.endsWith(".mesa") || file.contains(".mesa!");
-        TiogaReader r;
-        if( !r.read( in.readAll(), rfile, isCode ) )
-            d_title->setText(QString("error reading file: %1").arg(rfile));
-        else
+        d_doc->clear();
+        d_rendered = 0;
+        d_nodePos.clear();
+        d_outline->clear();
+        if( TiogaReader::isCodeFile(file) )
         {
-            if( isCode )
+            TiogaReader r;
+            r.setCache(d_cache);
+            if( !( archived ? r.read( member, rfile, true ) : r.read( in, rfile, true ) ) )
+                d_title->setText(QString("error reading file %1").arg(r.error));
+            else
             {
+                d_current = file;
                 d_switch->setCurrentWidget(d_codeViewer);
+                d_hl->setComments(r.text, r.spans);
                 d_codeViewer->setPlainText(r.text);
+                applyLooks(r.spans);
 #ifdef HAVE_PARSER
-                parseFile(r.text,file); // TEST
+                parseFile(r.text,file,r.spans); // TEST
 #endif
-            }else
+            }
+        }else
+        {
+            // documentation is decoded into the node tree up front, which is fast; only the
+            // layout of the QTextDocument is expensive, so it is built in pages on demand
+            d_switch->setCurrentWidget(d_docViewer);
+            d_docViewer->clear();
+            if( archived ? d_doc->parse(member) : d_doc->load(file) )
             {
-                d_switch->setCurrentWidget(d_docViewer);
-                d_docViewer->setText(r.text);
+                fillOutline();
+                renderMore();
+            }
+            else if( !d_doc->error().isEmpty() )
+                d_title->setText(QString("error reading file %1: %2").arg(rfile).arg(d_doc->error()));
+            else
+            {
+                if( !archived )
+                    member = in.readAll();
+                d_docViewer->setPlainText(TiogaReader::toString(member.constData(), member.size()));
             }
         }
     }else
         d_title->setText(QString("cannot open file for reading: %1").arg(rfile));
 }
 
-void TiogaViewer::parseFile(const QString& code, const QString& file)
+void TiogaViewer::openDecoded(const QString& path)
+{
+    // the corpus holds the output of TiogaReader for code; documentation is kept in Tioga format
+    // and paged like an unpacked file
+    TiogaCorpus::Entry e;
+    if( !d_corpus->read(path, e) )
+    {
+        d_title->setText(QString("%1 is not in the corpus").arg(path));
+        return;
+    }
+    d_doc->clear();
+    d_rendered = 0;
+    d_nodePos.clear();
+    d_outline->clear();
+    if( e.code )
+    {
+        d_current = d_root + "/" + path;
+        d_switch->setCurrentWidget(d_codeViewer);
+        d_hl->setComments(e.text, e.spans);
+        d_codeViewer->setPlainText(e.text);
+        applyLooks(e.spans);
+    }else
+    {
+        d_switch->setCurrentWidget(d_docViewer);
+        d_docViewer->clear();
+        if( !e.raw.isEmpty() )
+        {
+            if( d_doc->parse(e.raw) )
+            {
+                fillOutline();
+                renderMore();
+            }else
+                d_title->setText(QString("error reading file %1: %2").arg(path).arg(d_doc->error()));
+        }else if( e.tioga )
+            d_docViewer->setHtml(e.text); // documentation added with add() instead of addRaw()
+        else
+            d_docViewer->setPlainText(e.text);
+    }
+}
+
+void TiogaViewer::onDocScrolled()
+{
+    if( d_renderPending || d_rendered >= d_doc->nodeCount() )
+        return;
+    QScrollBar* sb = d_docViewer->verticalScrollBar();
+    if( sb->maximum() - sb->value() < 2 * sb->pageStep() )
+    {
+        // queued, so the scroll bar signals emitted while rendering don't recurse
+        d_renderPending = true;
+        QMetaObject::invokeMethod(this, "renderMore", Qt::QueuedConnection);
+    }
+}
+
+void TiogaViewer::renderMore()
+{
+    d_renderPending = false;
+    // roughly a few screenfuls per page; an empty node still takes a line
+    enum { PageChars = 16000, LineChars = 80 };
+    const int from = d_rendered;
+    int chars = 0;
+    while( d_rendered < d_doc->nodeCount() && chars < PageChars )
+        chars += d_doc->node(d_rendered++).textLen + LineChars;
+    if( d_rendered == from )
+        return;
+    TiogaDocBuilder b(d_docViewer->document());
+    d_doc->visit(&b, from, d_rendered);
+    foreach( int pos, b.positions() )
+        d_nodePos.append(pos);
+}
+
+void TiogaViewer::fillOutline()
+{
+    // the headings are taken from the node tree the paged rendering needs anyway
+    QList<QTreeWidgetItem*> parents; // the last item of each heading level
+    for( int i = 0; i < d_doc->nodeCount(); i++ )
+    {
+        const int h = TiogaReader::headingLevel(d_doc->format(i), d_doc->node(i).level);
+        if( h == 0 )
+            continue;
+        while( parents.size() >= h )
+            parents.pop_back();
+        QTreeWidgetItem* item = parents.isEmpty() ? new QTreeWidgetItem(d_outline)
+                                                  : new QTreeWidgetItem(parents.last());
+        item->setText(0, d_doc->text(i).simplified());
+        item->setData(0, Qt::UserRole, i);
+        while( parents.size() < h - 1 )
+            parents.append(item); // skipped levels
+        parents.append(item);
+    }
+    d_outline->expandAll();
+}
+
+void TiogaViewer::onOutlineClicked(QTreeWidgetItem* item, int)
+{
+    const int node = item->data(0, Qt::UserRole).toInt();
+    while( d_rendered <= node && d_rendered < d_doc->nodeCount() )
+        renderMore();
+    if( node >= d_nodePos.size() )
+        return;
+    QTextCursor cur(d_docViewer->document());
+    cur.setPosition(d_nodePos[node]);
+    d_docViewer->setTextCursor(cur);
+    // show the heading at the top of the viewport
+    QScrollBar* sb = d_docViewer->verticalScrollBar();
+    sb->setValue(sb->value() + d_docViewer->cursorRect(cur).top());
+}
+
+void TiogaViewer::applyLooks(const QVector<TiogaSpan>& spans)
+{
+    // the looks go to the document char formats once; the highlighter formats only overlay
+    // the properties they set, so bold procedure names etc. survive highlighting
+    QTextCursor cur(d_codeViewer->document());
+    cur.beginEditBlock();
+    QTextCharFormat f;
+    quint32 looks = 0;
+    foreach( const TiogaSpan& s, spans )
+    {
+        if( s.looks != looks )
+        {
+            f = QTextCharFormat();
+            TiogaDocBuilder::applyLooks(f, s.looks);
+            looks = s.looks;
+        }
+        if( f.properties().isEmpty() )
+            continue;
+        cur.setPosition(s.pos);
+        cur.setPosition(s.pos + s.len, QTextCursor::KeepAnchor);
+        cur.mergeCharFormat(f);
+    }
+    cur.endEditBlock();
+}
+
+void TiogaViewer::parseFile(const QString& code, const QString& file, const QVector<TiogaSpan>& spans)
 {
     d_errs->clear();
 
     Cedar::Lexer lex;
     lex.setStream(code,file);
+    lex.setComments(spans);
     Cedar::Parser p(&lex);
     p.RunParser();
 
@@ -221,10 +459,11 @@ void TiogaViewer::parseFile(const QString& code, const QString& file)
             QTreeWidgetItem* item = new QTreeWidgetItem(d_errs);
             item->setText(2, e.msg );
             item->setToolTip(2, item->text(2) );
-            item->setText(0, QFileInfo(e.path).completeBaseName() );
-            item->setToolTip(0, e.path );
+            const QString path = e.path();
+            item->setText(0, QFileInfo(path).completeBaseName() );
+            item->setToolTip(0, path );
             item->setText(1, QString("%1:%2").arg(e.row).arg(e.col));
-            item->setData(0, Qt::UserRole, e.path );
+            item->setData(0, Qt::UserRole, path );
             item->setData(1, Qt::UserRole, e.row );
             item->setData(2, Qt::UserRole, e.col );
         }
@@ -262,6 +501,120 @@ void TiogaViewer::onErrsClicked(QTreeWidgetItem* item, int)
     }
 }
 
+bool TiogaViewer::readCode(const QString& file, QString& text, QVector<TiogaSpan>& spans, QString& error)
+{
+    const QString rfile = file.mid(d_root.size());
+    if( d_corpus->isOpen() )
+    {
+        TiogaCorpus::Entry e;
+        if( !d_corpus->read(rfile.mid(1), e) )
+        {
+            error = QString("%1 is not in the corpus").arg(rfile);
+            return false;
+        }
+        text = e.text;
+        spans = e.spans;
+        return true;
+    }
+    TiogaReader r;
+    r.setCache(d_cache);
+    QByteArray member;
+    QFile in(file);
+    bool ok;
+    if( d_archive->isOpen() )
+        ok = d_archive->read(d_archive->find(rfile.mid(1)), member) && r.read(member, rfile, true);
+    else
+        ok = in.open(QIODevice::ReadOnly) && r.read(in, rfile, true);
+    if( !ok )
+    {
+        error = r.error.isEmpty() ? QString("cannot open file for reading: %1").arg(rfile) : r.error;
+        return false;
+    }
+    text = r.text;
+    spans = r.spans;
+    return true;
+}
+
+QString TiogaViewer::previousVersion(const QString& file) const
+{
+    // the versions x.mesa!1, x.mesa!2 ... are siblings in the file tree
+    const int bang = file.lastIndexOf('!');
+    const int slash = file.lastIndexOf('/');
+    if( bang < 0 || bang < slash )
+        return QString();
+    const int version = file.mid(bang + 1).toInt();
+    const QString prefix = file.mid(slash + 1, bang - slash);
+    QString res;
+    int best = 0;
+    foreach( QTreeWidgetItem* item, d_fileTree->findItems(prefix, Qt::MatchStartsWith | Qt::MatchCaseSensitive | Qt::MatchRecursive) )
+    {
+        const QString path = item->toolTip(0);
+        bool ok;
+        const int v = item->text(0).mid(prefix.size()).toInt(&ok);
+        if( ok && v < version && v > best && path.left(slash) == file.left(slash) )
+        {
+            best = v;
+            res = path;
+        }
+    }
+    return res;
+}
+
+void TiogaViewer::onDiff()
+{
+    if( d_current.isEmpty() || d_errs == 0 )
+        return;
+    const QString prev = previousVersion(d_current);
+    if( prev.isEmpty() )
+    {
+        d_title->setText(QString("%1 has no previous version").arg(d_current.mid(d_root.size())));
+        return;
+    }
+    QString oldText, newText, error;
+    QVector<TiogaSpan> oldSpans, newSpans;
+    if( !readCode(prev, oldText, oldSpans, error) || !readCode(d_current, newText, newSpans, error) )
+    {
+        d_title->setText(error);
+        return;
+    }
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    Cedar::Diff d;
+    Cedar::Diff::Tokens a, b;
+    d.tokenize(oldText, oldSpans, a);
+    d.tokenize(newText, newSpans, b);
+    const QList<Cedar::Diff::Hunk> hunks = Cedar::Diff::compare(a, b);
+
+    // the changes are listed in the issues and marked in the shown (i.e. newer) version
+    const QStringList oldLines = oldText.split('\n');
+    QList<QTextEdit::ExtraSelection> marks;
+    d_errs->clear();
+    foreach( const Cedar::Diff::Hunk& h, hunks )
+    {
+        QTreeWidgetItem* item = new QTreeWidgetItem(d_errs);
+        item->setText(0, h.aLen == 0 ? tr("inserted") : h.bLen == 0 ? tr("deleted") : tr("changed") );
+        item->setText(1, QString("%1:%2").arg(h.bLine).arg(h.bLines));
+        item->setData(1, Qt::UserRole, qMax(h.bLine, 1) );
+        item->setData(2, Qt::UserRole, 1 );
+        const QStringList old = oldLines.mid(h.aLine - 1, h.aLines);
+        item->setText(2, old.isEmpty() ? QString() : old.first().simplified() );
+        item->setToolTip(2, old.join("\n") );
+
+        QTextEdit::ExtraSelection sel;
+        sel.format.setBackground( h.bLen == 0 ? QColor(255, 220, 220) : QColor(220, 255, 220) );
+        sel.format.setProperty(QTextFormat::FullWidthSelection, true);
+        for( int i = qMax(h.bLine, 1); i < h.bLine + qMax(h.bLines, 1); i++ )
+        {
+            sel.cursor = QTextCursor(d_codeViewer->document()->findBlockByNumber(i - 1));
+            marks.append(sel);
+        }
+    }
+    d_codeViewer->setExtraSelections(marks);
+    d_errs->parentWidget()->show();
+    d_title->setText(QString("%1: %2 changes against %3").arg(d_current.mid(d_root.size()))
+                     .arg(hunks.size()).arg(prev.mid(d_root.size())));
+    QApplication::restoreOverrideCursor();
+}
+
 void TiogaViewer::onOpen()
 {
     const QString path = QFileDialog::getExistingDirectory(this,
@@ -271,6 +624,15 @@ void TiogaViewer::onOpen()
     setRootPath(path);
 }
 
+void TiogaViewer::onOpenArchive()
+{
+    const QString path = QFileDialog::getOpenFileName(this, "Select Archive of Source Tree", d_root,
+                                                      "Archives (*.tar *.tar.gz *.tgz *.zip *.tcorpus)" );
+    if( path.isEmpty() )
+        return;
+    setRootPath(path);
+}
+
 void TiogaViewer::createFileTree()
 {
     QDockWidget* dock = new QDockWidget( tr("Files"), this );
@@ -288,6 +650,23 @@ void TiogaViewer::createFileTree()
     connect( d_fileTree,SIGNAL(itemClicked(QTreeWidgetItem*,int)), this, SLOT(onFileClicked(QTreeWidgetItem*,int)) );
 }
 
+void TiogaViewer::createOutline()
+{
+    QDockWidget* dock = new QDockWidget( tr("Outline"), this );
+    dock->setObjectName("Outline");
+    dock->setAllowedAreas( Qt::AllDockWidgetAreas );
+    dock->setFeatures( QDockWidget::DockWidgetMovable );
+    d_outline = new QTreeWidget(dock);
+    d_outline->setAlternatingRowColors(true);
+    d_outline->setSortingEnabled(false);
+    d_outline->setAllColumnsShowFocus(true);
+    d_outline->setRootIsDecorated(true);
+    d_outline->setHeaderHidden(true);
+    dock->setWidget(d_outline);
+    addDockWidget( Qt::LeftDockWidgetArea, dock );
+    connect( d_outline,SIGNAL(itemClicked(QTreeWidgetItem*,int)), this, SLOT(onOutlineClicked(QTreeWidgetItem*,int)) );
+}
+
 void TiogaViewer::createErrs()
 {
     QDockWidget* dock = new QDockWidget( tr("Issues"), this );
@@ -320,7 +699,8 @@ int main(int argc, char *argv[])
     if( a.arguments().size() >= 2 )
     {
         QFileInfo info(a.arguments()[1]);
-        if( info.isFile() )
+        if( info.isFile() && !TiogaArchive::isArchive(info.filePath())
+                && !TiogaCorpus::isCorpus(info.filePath()) )
             w.openFile(info.absoluteFilePath());
         else
             w.setRootPath(info.absoluteFilePath());
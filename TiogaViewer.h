@@ -18,6 +18,7 @@
 */
 
 #include <QMainWindow>
+#include <QVector>
 
 class QTreeWidget;
 class QTreeWidgetItem;
@@ -25,32 +26,61 @@ class QTextBrowser;
 class QPlainTextEdit;
 class QStackedWidget;
 class QLabel;
+class TiogaCache;
+class TiogaDocument;
+class TiogaArchive;
+class TiogaCorpus;
+struct TiogaSpan;
+namespace Cedar { class Highlighter; }
 
 class TiogaViewer : public QMainWindow
 {
     Q_OBJECT
 public:
     explicit TiogaViewer(QWidget *parent = 0);
+    ~TiogaViewer();
     void setRootPath( const QString& );
     void openFile( const QString& );
-    void parseFile(const QString& code, const QString& );
+    void parseFile(const QString& code, const QString&, const QVector<TiogaSpan>& spans );
+    void openDecoded(const QString& path);
 signals:
 
 protected slots:
     void onFileClicked(QTreeWidgetItem*,int);
     void onErrsClicked(QTreeWidgetItem*,int);
     void onOpen();
+    void onOpenArchive();
+    void onDocScrolled();
+    void renderMore();
+    void onOutlineClicked(QTreeWidgetItem*,int);
+    void onDiff();
 protected:
     void createFileTree();
+    void fillNames(const QStringList&);
     void createErrs();
+    void createOutline();
+    void fillOutline();
+    void applyLooks(const QVector<TiogaSpan>&);
+    bool readCode(const QString& file, QString& text, QVector<TiogaSpan>& spans, QString& error);
+    QString previousVersion(const QString& file) const;
 private:
     QTreeWidget* d_fileTree;
     QTextBrowser* d_docViewer;
     QPlainTextEdit* d_codeViewer;
+    Cedar::Highlighter* d_hl;
     QString d_root;
+    QString d_current; // the code file shown
     QLabel* d_title;
     QStackedWidget* d_switch;
     QTreeWidget* d_errs;
+    TiogaCache* d_cache;
+    TiogaArchive* d_archive; // open if the root is an archive instead of a directory
+    TiogaCorpus* d_corpus; // open if the root is a corpus of already decoded files
+    TiogaDocument* d_doc; // the documentation file shown, rendered in pages as the user scrolls
+    int d_rendered; // number of nodes of d_doc in d_docViewer
+    QVector<int> d_nodePos; // document position of each rendered node
+    QTreeWidget* d_outline;
+    bool d_renderPending;
 };
 
 #endif // TIOGAVIEWER_H
@@ -7,22 +7,36 @@ INCLUDEPATH += ..
 
 SOURCES += \
     TiogaReader.cpp \
+    TiogaCache.cpp \
+    TiogaArchive.cpp \
+    TiogaCorpus.cpp \
+    TiogaDocument.cpp \
+    TiogaDocBuilder.cpp \
     TiogaViewer.cpp \
     CedarHighlighter.cpp \
     CedarLexer.cpp \
+    CedarDiff.cpp \
     CedarToken.cpp \
     CedarTokenType.cpp \
+    CedarKeywords.cpp \
     CedarParser.cpp \
     CedarSynTree.cpp
 
 HEADERS  += \
     TiogaReader.h \
+    TiogaCache.h \
+    TiogaArchive.h \
+    TiogaCorpus.h \
+    TiogaDocument.h \
+    TiogaDocBuilder.h \
     TiogaViewer.h \
     CedarHighlighter.h \
     CedarLexer.h \
+    CedarDiff.h \
     CedarRowCol.h \
     CedarToken.h \
     CedarTokenType.h \
+    CedarKeywords.h \
     CedarParser.h \
     CedarSynTree.h
 
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+# Generates ../CedarKeywords.h and ../CedarKeywords.cpp from Cedar.keywords.
+#
+# Copyright (C) 2023 Rochus Keller (me@rochus-keller.ch)
+# Licensed under the same terms as the rest of the Cedar/Mesa project (LGPL 2.1 or 3).
+#
+# The keywords get a perfect hash: FNV-1a with a seed found here, the top bits of which index a
+# slot table without collisions. A lookup costs one hash and one compare. Run it again after
+# changing Cedar.keywords and check in the result, like the files generated by EbnfStudio.
+
+import os
+import sys
+
+SLOT_BITS = 10  # 1024 one-byte slots for ~120 keywords; a seed is found after a few thousand tries
+MASK32 = 0xffffffff
+
+def fnv(seed, word):
+    h = seed
+    for c in word.encode('latin-1'):
+        h = ((h ^ c) * 16777619) & MASK32
+    return h >> (32 - SLOT_BITS)
+
+def find_seed(words):
+    seed = 2166136261
+    for attempt in range(1000000):
+        slots = set()
+        for w in words:
+            i = fnv(seed, w)
+            if i in slots:
+                break
+            slots.add(i)
+        else:
+            return seed
+        seed = (seed * 1103515245 + 12345) & MASK32
+    sys.exit("no perfect hash found; increase SLOT_BITS")
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    with open(os.path.join(here, "Cedar.keywords")) as f:
+        words = sorted(set(w.strip() for w in f if w.strip()))
+    if len(words) > 255:
+        sys.exit("more keywords than one-byte slots can address")
+    seed = find_seed(words)
+    slots = [0] * (1 << SLOT_BITS)
+    for n, w in enumerate(words):
+        slots[fnv(seed, w)] = n + 1
+    min_len = min(len(w) for w in words)
+    max_len = max(len(w) for w in words)
+    first = sorted(set(w[0] for w in words))
+
+    header = """#ifndef CEDARKEYWORDS_H
+#define CEDARKEYWORDS_H
+// This file was automatically generated by syntax/gen_keywords.py; don't modify it!
+
+#include <CedarTokenType.h>
+
+namespace Cedar {
+	// the keyword spelled exactly (case sensitive) by str and len, or Tok_Invalid
+	TokenType keywordType( const char* str, int len );
+}
+#endif // CEDARKEYWORDS_H
+"""
+    out = []
+    out.append("// This file was automatically generated by syntax/gen_keywords.py; don't modify it!")
+    out.append('#include "CedarKeywords.h"')
+    out.append("#include <string.h>")
+    out.append("")
+    out.append("namespace Cedar {")
+    out.append("")
+    out.append("\tenum { ckw_SlotBits = %d, ckw_MinLen = %d, ckw_MaxLen = %d };" % (SLOT_BITS, min_len, max_len))
+    out.append("\tstatic const quint32 ckw_seed = %du;" % seed)
+    out.append("")
+    out.append("\tstruct ckw_Keyword { const char* str; quint8 len; quint8 type; };")
+    out.append("")
+    out.append("\tstatic const ckw_Keyword ckw_keywords[] = {")
+    out.append("\t\t{ \"\", 0, Tok_Invalid },")
+    for w in words:
+        out.append("\t\t{ \"%s\", %d, Tok_%s }," % (w, len(w), w))
+    out.append("\t};")
+    out.append("")
+    out.append("\t// index into ckw_keywords by the hash, 0 for none")
+    out.append("\tstatic const quint8 ckw_slots[%d] = {" % len(slots))
+    for i in range(0, len(slots), 32):
+        out.append("\t\t" + ",".join(str(s) for s in slots[i:i + 32]) + ",")
+    out.append("\t};")
+    out.append("")
+    out.append("\tTokenType keywordType( const char* str, int len ) {")
+    out.append("\t\tif( len < ckw_MinLen || len > ckw_MaxLen || str[0] < '%s' || str[0] > '%s' )" % (first[0], first[-1]))
+    out.append("\t\t\treturn Tok_Invalid;")
+    out.append("\t\tquint32 h = ckw_seed;")
+    out.append("\t\tfor( int i = 0; i < len; i++ )")
+    out.append("\t\t\th = ( h ^ quint8(str[i]) ) * 16777619u;")
+    out.append("\t\tconst ckw_Keyword& k = ckw_keywords[ ckw_slots[ h >> ( 32 - ckw_SlotBits ) ] ];")
+    out.append("\t\tif( k.len == len && ::memcmp( k.str, str, len ) == 0 )")
+    out.append("\t\t\treturn TokenType(k.type);")
+    out.append("\t\treturn Tok_Invalid;")
+    out.append("\t}")
+    out.append("}")
+    out.append("")
+
+    root = os.path.dirname(here)
+    with open(os.path.join(root, "CedarKeywords.h"), "w") as f:
+        f.write(header)
+    with open(os.path.join(root, "CedarKeywords.cpp"), "w") as f:
+        f.write("\n".join(out))
+
+if __name__ == "__main__":
+    main()